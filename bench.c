@@ -0,0 +1,420 @@
+// Microbenchmarks of simulation and render hot paths.
+//
+// Build next to main.c:
+//   g++ -O2 bench.c -o bench `sdl2-config --cflags --libs` -lSDL2_image -lSDL2_mixer
+// Run from repository root, so that spritesheet can be found:
+//   ./bench [--samples N] [--json FILE] [--kernel NAME] [--formation ROWSxCOLS] [--bullets N]
+// Formation and bullets set the biggest formation and bullet count swept,
+// same as they set the stress mode of the game.
+//
+// Rendering goes to the null renderer (there is no SDL renderer at all),
+// so render benchmarks measure only the work done by the game itself.
+
+#define SPACE_INVADERS_NO_MAIN
+#include "main.c"
+
+#define BENCH_WARMUP_SAMPLES     5
+#define BENCH_DEFAULT_SAMPLES    30
+#define BENCH_MAX_SAMPLES        1000
+// every sample consists of that many rounds of (restore world, run ops)
+#define BENCH_ROUNDS             50
+#define BENCH_SEED               0x2545F491
+// pairwise kernels are skipped above that many bullet-alien pairs
+#define BENCH_MAX_PAIRS          10000000
+
+// where bullets are placed
+enum e_benchTargets
+{
+    TARGET_RANDOM,
+    TARGET_SHIELDS,
+    TARGET_ALIENS
+};
+
+enum e_killPatterns
+{
+    KILL_NONE,
+    KILL_CHECKER,
+    KILL_EDGES,
+    KILL_ALL_BUT_ONE,
+    KILL_PATTERN_COUNT
+};
+
+typedef struct
+{
+    const char *name;
+    void (*run)();
+    // untimed, called after every world restore
+    void (*prepare)();
+    // ops run after every world restore
+    t_u8 opsPerRound;
+    bool usesAliens;
+    bool usesBullets;
+    t_u8 target;
+    // checks every bullet against every alien
+    bool isPairwise;
+} t_benchKernel;
+
+typedef struct
+{
+    t_u16 rows, cols;
+} t_benchFormation;
+
+typedef struct
+{
+    double mean, stddev, min, median;
+} t_benchStats;
+
+void runUpdateBullets() { updateBullets(); }
+void runUpdateAliensEdges() { updateAliensEdges(); }
+void runUpdateAliens() { updateAliens(); g_game.ticks++; }
+void runShoot() { shoot(g_game.ticks % 2 ? ALIEN_ENTITY : PLAYER_ENTITY, 0, 0); g_game.ticks++; }
+void runUpdate() { update(); }
+void runRenderAliens() { renderAliens(); }
+void runCollideBullets() { collideBullets(); }
+void runRenderBullets() { renderBullets(); }
+void runShieldUpload() { updateBullets(); updateShieldsTexture(); }
+
+t_u32 g_collisions;
+
+// every bullet against every alive alien, with masks or with boxes only
+void runCollisions(bool useMasks)
+{
+    t_u32 i;
+    t_u16 row, col;
+
+    for (i = 0; i < g_game.lastBullet; i++)
+        if (g_bullets[i].isVisible)
+            for (row = 0; row < g_options.formationRows; row++)
+                for (col = 0; col < g_options.formationCols; col++)
+                    if (getAlien(col, row)->deathTime == 0)
+                    {
+                        const t_spriteMask *mask = &g_alienMasks[getAlien(col, row)->entity][0];
+                        t_i32 x = formationX(&g_aliensData, col);
+                        t_i32 y = formationY(&g_aliensData, row);
+                        t_i32 bx = g_bullets[i].position.x, by = g_bullets[i].position.y;
+
+                        if (useMasks)
+                            g_collisions += masksOverlap(mask, x, y, &g_bulletMask, bx, by);
+                        else
+                            g_collisions += !(x >= bx + g_bulletMask.w || bx >= x + mask->w ||
+                                y >= by + g_bulletMask.h || by >= y + mask->h);
+                    }
+}
+
+void runCollideMasks() { runCollisions(true); }
+void runCollideBoxes() { runCollisions(false); }
+
+// one op of update kernel is a whole simulation tick,
+// so its ops/s is the ticks per second rate
+const t_benchKernel g_kernels[] =
+{
+    { "updateBullets",     runUpdateBullets,     NULL,                  8,  true,  true,  TARGET_RANDOM, false },
+    { "updateAliensEdges", runUpdateAliensEdges, NULL,                  8,  true,  false, TARGET_RANDOM, false },
+    { "updateAliens",      runUpdateAliens,      NULL,                  40, true,  false, TARGET_RANDOM, false },
+    { "shoot",             runShoot,             NULL,                  8,  false, true,  TARGET_RANDOM, false },
+    // player and aliens' bullets against each other, steady state
+    // with order by x kept from the previous tick
+    { "collideBullets",    runCollideBullets,    NULL,                  8,  false, true,  TARGET_RANDOM, false },
+    { "update",            runUpdate,            NULL,                  8,  true,  true,  TARGET_RANDOM, false },
+    { "renderAliens",      runRenderAliens,      NULL,                  8,  true,  false, TARGET_RANDOM, false },
+    { "renderBullets",     runRenderBullets,     NULL,                  8,  false, true,  TARGET_RANDOM, false },
+    // heavy fire into all four shields, alone and with dirty area upload
+    { "shieldHits",        runUpdateBullets,     NULL,                  8,  false, true,  TARGET_SHIELDS, false },
+    { "shieldUpload",      runShieldUpload,      updateShieldsTexture,  8,  false, true,  TARGET_SHIELDS, false },
+    // pixel accurate collision compared to bounding boxes alone,
+    // with bullets all around aliens so that boxes overlap often
+    { "collideMasks",      runCollideMasks,      NULL,                  8,  true,  true,  TARGET_ALIENS, true },
+    { "collideBoxes",      runCollideBoxes,      NULL,                  8,  true,  true,  TARGET_ALIENS, true },
+};
+
+// last one is the whole formation of the game
+t_benchFormation g_formations[] =
+{
+    { 1, 1 },
+    { 2, 3 },
+    { ALIENS_COUNT, ALIENS_IN_ROW },
+};
+
+const char *g_killPatternNames[KILL_PATTERN_COUNT] =
+{
+    "none",
+    "checker",
+    "edges",
+    "all-but-one"
+};
+
+// last one is bullets limit of the game
+t_u32 g_bulletCounts[] = { 0, 10, 25, MAX_BULLETS };
+
+void setupWorld(const t_benchFormation *formation, t_u8 pattern, t_u32 bullets, t_u8 target)
+{
+    t_u16 row, col;
+    t_u32 i, seed = BENCH_SEED;
+
+    startGame();
+    g_game.rngState = BENCH_SEED;
+    g_game.ticks = 1;
+
+    // aliens outside of formation and the ones matching kill pattern
+    // are dead with explosion animation already finished
+    for (row = 0; row < g_options.formationRows; row++)
+        for (col = 0; col < g_options.formationCols; col++)
+        {
+            bool isDead = row >= formation->rows || col >= formation->cols;
+
+            if (pattern == KILL_CHECKER)
+                isDead |= (row + col) % 2 == 1;
+            else if (pattern == KILL_EDGES)
+                isDead |= col == 0 || col == formation->cols - 1;
+            else if (pattern == KILL_ALL_BUT_ONE)
+                isDead |= row > 0 || col > 0;
+
+            if (isDead)
+            {
+                getAlien(col, row)->deathTime = 1;
+                getAlien(col, row)->isHidden = true;
+                g_aliensData.aliveCount--;
+                g_aliensData.hiddenCount++;
+            }
+        }
+    updateAliensEdges();
+
+    // half of bullets are player's moving up through formation,
+    // another half are aliens' moving down to the player
+    for (i = 0; i < bullets; i++)
+    {
+        g_bullets[i].entity = i % 2 ? ALIEN_ENTITY : PLAYER_ENTITY;
+        g_bullets[i].isVisible = true;
+        g_bullets[i].isSorted = false;
+        g_shotBullets[g_game.shotBullets++] = i;
+
+        if (target == TARGET_SHIELDS)
+        {
+            // bullets queue up right below and above shields
+            t_u8 shield = i / 2 % SHIELDS_COUNT;
+            t_i32 distance = i / 2 / SHIELDS_COUNT * BULLET_SPEED;
+
+            g_bullets[i].position.x = shieldX(shield) + nextRandom(&seed) % (SHIELD_W - BULLET_W);
+            g_bullets[i].position.y = g_bullets[i].entity == PLAYER_ENTITY
+                ? SHIELD_Y + SHIELD_H + distance
+                : SHIELD_Y - BULLET_H - distance;
+        }
+        else if (target == TARGET_ALIENS)
+        {
+            // somewhere in or around box of a formation alien
+            t_u16 col = nextRandom(&seed) % formation->cols;
+            t_u16 row = nextRandom(&seed) % formation->rows;
+
+            g_bullets[i].position.x = ALIENS_PADDING_LEFT - BULLET_W +
+                col * ALIEN_CELL_W +
+                nextRandom(&seed) % (ALIEN_W + BULLET_W);
+            g_bullets[i].position.y = ALIENS_PADDING_TOP - BULLET_H +
+                row * ALIEN_CELL_H +
+                nextRandom(&seed) % (ALIEN_H + BULLET_H);
+        }
+        else
+        {
+            g_bullets[i].position.x = nextRandom(&seed) % (g_world.w - BULLET_W);
+            g_bullets[i].position.y = ALIENS_PADDING_TOP + nextRandom(&seed) % (g_world.h - ALIENS_PADDING_TOP);
+        }
+    }
+    g_game.lastBullet = bullets;
+    g_game.visibleBullets = bullets;
+
+    // as sorted by previous ticks
+    sortBullets();
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+t_benchStats measure(const t_benchKernel *kernel, const t_worldState *world, t_u16 samples)
+{
+    static double nsPerOp[BENCH_MAX_SAMPLES];
+    double frequency = SDL_GetPerformanceFrequency();
+    t_benchStats stats;
+    t_u16 sample, round, op;
+
+    for (sample = 0; sample < BENCH_WARMUP_SAMPLES + samples; sample++)
+    {
+        Uint64 elapsed = 0;
+
+        for (round = 0; round < BENCH_ROUNDS; round++)
+        {
+            loadWorld(world);
+            if (kernel->prepare != NULL)
+                kernel->prepare();
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (op = 0; op < kernel->opsPerRound; op++)
+                kernel->run();
+            elapsed += SDL_GetPerformanceCounter() - start;
+        }
+
+        // warm-up samples are thrown away
+        if (sample >= BENCH_WARMUP_SAMPLES)
+            nsPerOp[sample - BENCH_WARMUP_SAMPLES] =
+                elapsed * 1e9 / frequency / (BENCH_ROUNDS * kernel->opsPerRound);
+    }
+
+    stats.mean = 0;
+    for (sample = 0; sample < samples; sample++)
+        stats.mean += nsPerOp[sample];
+    stats.mean /= samples;
+
+    stats.stddev = 0;
+    for (sample = 0; sample < samples; sample++)
+        stats.stddev += (nsPerOp[sample] - stats.mean) * (nsPerOp[sample] - stats.mean);
+    stats.stddev = samples > 1 ? SDL_sqrt(stats.stddev / (samples - 1)) : 0;
+
+    qsort(nsPerOp, samples, sizeof(double), compareDoubles);
+    stats.min = nsPerOp[0];
+    stats.median = nsPerOp[samples / 2];
+
+    return stats;
+}
+
+int main(int argc, char *argv[])
+{
+    t_u16 samples = BENCH_DEFAULT_SAMPLES;
+    const char *jsonPath = NULL;
+    const char *kernelName = NULL;
+    FILE *json = NULL;
+    t_worldState world;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            int value = atoi(argv[++i]);
+            samples = SDL_min(SDL_max(value, 1), BENCH_MAX_SAMPLES);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+            kernelName = argv[++i];
+        // formation and bullets limit are parsed the same way game does
+        else if ((strcmp(argv[i], "--formation") == 0 || strcmp(argv[i], "--bullets") == 0) && i + 1 < argc)
+        {
+            char *option[] = { argv[0], argv[i], argv[i + 1] };
+
+            if (!parseArgs(3, option))
+                return 1;
+            i++;
+        }
+        else
+        {
+            printf("Usage: %s [--samples N] [--json FILE] [--kernel NAME] [--formation ROWSxCOLS] [--bullets N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // no window, no renderer and no sounds
+    g_isMuted = true;
+    IMG_Init(IMG_INIT_PNG);
+
+    char spritePath[] = "assets/spritesheet.png";
+    if (!initSpritesData(spritePath))
+    {
+        printf("Sprite init error\n");
+        return 1;
+    }
+
+    initWorldSize();
+    if (!initWorld() || !initWorldState(&world))
+    {
+        printf("World init error\n");
+        return 1;
+    }
+
+    g_formations[SDL_arraysize(g_formations) - 1].rows = g_options.formationRows;
+    g_formations[SDL_arraysize(g_formations) - 1].cols = g_options.formationCols;
+    g_bulletCounts[SDL_arraysize(g_bulletCounts) - 1] = g_options.maxBullets;
+
+    if (jsonPath != NULL)
+    {
+        json = fopen(jsonPath, "w");
+        if (json == NULL)
+        {
+            printf("Unable to open %s for writing\n", jsonPath);
+            return 1;
+        }
+
+        fprintf(json, "{\n  \"warmup_samples\": %d,\n  \"samples\": %d,\n  \"rounds\": %d,\n  \"results\": [",
+            BENCH_WARMUP_SAMPLES, samples, BENCH_ROUNDS);
+    }
+
+    printf("%-18s %-9s %-12s %7s %12s %10s %12s %12s %14s\n",
+        "kernel", "formation", "pattern", "bullets",
+        "mean ns/op", "stddev", "min", "median", "ops/s");
+
+    bool isFirst = true;
+    t_u8 k, f, p, b;
+
+    for (k = 0; k < SDL_arraysize(g_kernels); k++)
+        for (f = 0; f < SDL_arraysize(g_formations); f++)
+            for (p = 0; p < KILL_PATTERN_COUNT; p++)
+                for (b = 0; b < SDL_arraysize(g_bulletCounts); b++)
+                {
+                    const t_benchKernel *kernel = &g_kernels[k];
+
+                    if (kernelName != NULL && strcmp(kernel->name, kernelName) != 0)
+                        continue;
+                    // skip sweeps kernel doesn't depend on
+                    if (!kernel->usesAliens && (f != SDL_arraysize(g_formations) - 1 || p != KILL_NONE))
+                        continue;
+                    if (!kernel->usesBullets && b != 0)
+                        continue;
+                    // and sizes that don't fit into the world
+                    if (g_formations[f].rows > g_options.formationRows ||
+                        g_formations[f].cols > g_options.formationCols ||
+                        g_bulletCounts[b] > g_options.maxBullets)
+                        continue;
+                    if (kernel->isPairwise &&
+                        (t_u64)g_formations[f].rows * g_formations[f].cols * g_bulletCounts[b] > BENCH_MAX_PAIRS)
+                        continue;
+
+                    setupWorld(&g_formations[f], p, g_bulletCounts[b], kernel->target);
+                    saveWorld(&world);
+
+                    t_benchStats stats = measure(kernel, &world, samples);
+
+                    printf("%-18s %5dx%-3d %-12s %7d %12.1f %10.1f %12.1f %12.1f %14.0f\n",
+                        kernel->name, g_formations[f].rows, g_formations[f].cols,
+                        g_killPatternNames[p], g_bulletCounts[b],
+                        stats.mean, stats.stddev, stats.min, stats.median, 1e9 / stats.mean);
+
+                    if (json != NULL)
+                    {
+                        fprintf(json,
+                            "%s\n    { \"kernel\": \"%s\", \"formation_rows\": %d, \"formation_cols\": %d, "
+                            "\"kill_pattern\": \"%s\", \"bullets\": %d, \"ns_per_op_mean\": %.2f, "
+                            "\"ns_per_op_stddev\": %.2f, \"ns_per_op_min\": %.2f, \"ns_per_op_median\": %.2f, "
+                            "\"ops_per_sec\": %.0f }",
+                            isFirst ? "" : ",",
+                            kernel->name, g_formations[f].rows, g_formations[f].cols,
+                            g_killPatternNames[p], g_bulletCounts[b],
+                            stats.mean, stats.stddev, stats.min, stats.median, 1e9 / stats.mean);
+                        isFirst = false;
+                    }
+                }
+
+    if (json != NULL)
+    {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+
+    printf("\nnull renderer sprites: %u, collisions: %u\n", g_SDLData.nullRenderCount, g_collisions);
+
+    closeWorldState(&world);
+    closeWorld();
+
+    IMG_Quit();
+
+    return 0;
+}
@@ -1,14 +1,35 @@
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_mixer.h>
 
+#include "telemetry.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define SCREEN_W                 640
 #define SCREEN_H                 480
 #define SPRITE_CELL_W            32
 #define SPRITE_CELL_H            20
+#define PLAYER_W                 SPRITE_CELL_W
+#define PLAYER_H                 SPRITE_CELL_H
+#define PLAYER_LIFE_W            (PLAYER_W * 2 / 3)
+#define PLAYER_LIFE_H            (PLAYER_H * 2 / 3)
+#define ALIEN_W                  SPRITE_CELL_W
+#define ALIEN_H                  SPRITE_CELL_H
+#define UFO_W                    SPRITE_CELL_W
+#define UFO_H                    SPRITE_CELL_H
 #define PLAYER_SPEED             4
 #define PLAYER_SHOOT_DELAY       30
 #define PLAYER_MAX_LIFES         4
@@ -18,15 +39,64 @@
 #define ALIENS_MOVE_STEP         8
 #define ALIENS_PADDING_LEFT      42
 #define ALIENS_PADDING_TOP       60
+// default formation, other one can be set from command line
 #define ALIENS_IN_ROW            6
 #define ALIENS_COL_SPACING       25
 #define ALIENS_ROW_SPACING       20
+// distance between neighbour aliens of formation
+#define ALIEN_CELL_W             (ALIEN_W + ALIENS_COL_SPACING)
+#define ALIEN_CELL_H             (ALIEN_H + ALIENS_ROW_SPACING)
 #define ALIENS_DESCEND_STEP      25
 #define ALIEN_EXPLOSION_TIME     32
 #define BULLET_W                 4
-#define BULLET_H                 18
+#define BULLET_H                 12
 #define MAX_BULLETS              50
+#define FORMATION_MAX_ROWS       1000
+#define FORMATION_MAX_COLS       1000
+#define BULLETS_LIMIT            1000000
 #define BULLET_SPEED             8
+// bullets that can meet within a tick are at most one band apart
+#define BULLET_BAND_H            (2 * BULLET_H + 2 * BULLET_SPEED)
+#define ALIEN_SCORE_STEP         10
+#define SHIELDS_COUNT            4
+#define SHIELD_W                 44
+#define SHIELD_H                 32
+#define SHIELD_Y                 (g_world.h - 96)
+#define SHIELD_CRATER_W          8
+#define SHIELD_CRATER_H          6
+#define SPRITE_MASK_ALPHA        0x80
+#define UFO_Y                    30
+#define UFO_SPEED                2
+#define UFO_INTERVAL             1200
+#define UFO_SCORE_STEP           50
+#define TICKS_PER_SECOND         60
+#define AUDIO_TIMELINE_SIZE      64
+#define AUDIO_MAX_VOICES         8
+#define TIMER_WHEEL_BITS         6
+#define TIMER_WHEEL_SLOTS        (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS       2
+// timers that are not bound to aliens
+#define EXTRA_TIMERS             4
+#define HUD_GLYPH_W              5
+#define HUD_GLYPH_H              7
+#define HUD_GLYPH_SCALE          2
+#define HUD_TEXT_MAX             32
+#define AUTOPILOT_MAX_THREADS    64
+#define AUTOPILOT_DECISION_TICKS 8
+#define AUTOPILOT_HORIZON        120
+#define AUTOPILOT_BUDGET_MS      12
+#define AUTOPILOT_HIT_PENALTY    1000
+#define AUTOPILOT_SCORE_REWARD   7
+#define REPLAY_VERSION           3
+#define REPLAY_KEYFRAME_TICKS    600
+// input of a tick is movement direction and this bit for shooting
+#define REPLAY_INPUT_SHOOTING    0x04
+#define REPLAY_BAR_H             6
+#define SPECTATOR_MAX_WORLDS     1024
+// worlds with nothing going on are drawn once per this many frames
+#define SPECTATOR_IDLE_FRAMES    8
+// how long a world stays interesting after a wave or a life is lost
+#define SPECTATOR_INTEREST_TICKS 120
 
 // enums
 enum e_movingDirections
@@ -55,53 +125,186 @@ enum e_aliens
     ALIENS_COUNT
 };
 
+// sounds scheduled on audio timeline
+enum e_timelineCommands
+{
+    TIMELINE_MARCH,
+    TIMELINE_UFO_START,
+    TIMELINE_UFO_STOP
+};
+
+// things that happen when timer expires
+enum e_timerKinds
+{
+    TIMER_ALIEN_EXPLOSION,
+    TIMER_UFO_EXPLOSION,
+    TIMER_PLAYER_INVINCIBLE,
+    TIMER_PLAYER_RESTART,
+    TIMER_SHOOT_COOLDOWN
+};
+
+// parts of the game hardware counters are attributed to
+enum e_perfSubsystems
+{
+    PERF_UPDATE_TIMERS,
+    PERF_UPDATE_PLAYER,
+    PERF_UPDATE_ALIENS,
+    PERF_UPDATE_ALIENS_EDGES,
+    PERF_UPDATE_BULLETS,
+    PERF_COLLIDE_BULLETS,
+    PERF_UPDATE_UFO,
+    PERF_RENDER_PLAYER,
+    PERF_RENDER_LIFE_BAR,
+    PERF_RENDER_ALIENS,
+    PERF_RENDER_BULLETS,
+    PERF_RENDER_UFO,
+    PERF_RENDER_SHIELDS,
+    PERF_RENDER_HUD,
+    PERF_SUBSYSTEM_COUNT
+};
+
+enum e_perfEvents
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_EVENT_COUNT
+};
+
+enum e_autopilotActions
+{
+    AUTOPILOT_IDLE,
+    AUTOPILOT_LEFT,
+    AUTOPILOT_RIGHT,
+    AUTOPILOT_FIRE,
+    AUTOPILOT_ACTION_COUNT
+};
+
 // typedef
 typedef char           t_i8;
 typedef short          t_i16;
 typedef int            t_i32;
-typedef long           t_i64;
+typedef long long      t_i64;
 
 typedef unsigned char  t_u8;
 typedef unsigned short t_u16;
 typedef unsigned int   t_u32;
-typedef unsigned long  t_u64;
+typedef unsigned long long t_u64;
 
 typedef struct 
 {
     SDL_Window *pWindow;
     SDL_Renderer *pRenderer;
+    // fixed size target whole game is rendered into
+    SDL_Texture *pTarget;
+    // sprites "drawn" while there is no renderer
+    t_u32 nullRenderCount;
 } t_SDLData;
 
 typedef struct 
 {
     t_u32 ticks;
     bool isRunning;
-    t_u8 lastBullet;
+    // bullets at and after this index are all free
+    t_u32 lastBullet;
+    // no free bullet before this index, where search for one starts
+    t_u32 freeBullet;
+    // bullets put into order by x
+    t_u32 sortedBullets;
+    // bullets shot since they were last put into order
+    t_u32 shotBullets;
+    // bullets in play, kept up to date so that they are never counted
+    t_u32 visibleBullets;
+    // state of world's own random generator, so that
+    // world can be copied and simulated deterministically
+    t_u32 rngState;
+    t_u32 score;
+    t_u16 wave;
 } t_game;
 
 typedef struct 
 {
     SDL_Texture *pTexture;
-    SDL_Rect playerClip[1];
-    SDL_Rect ufoClip[1];
-    SDL_Rect alien1Clip[2];
-    SDL_Rect alien2Clip[2];
-    SDL_Rect alien3Clip[2];
-    SDL_Rect alien4Clip[2];
-    SDL_Rect explosionClip[4];
-    SDL_Rect bulletClip[1];
+    // all shields side by side, updated as they get damaged
+    SDL_Texture *pShieldsTexture;
 } t_spritesData;
 
+typedef struct
+{
+    SDL_Rect player;
+    SDL_Rect ufo;
+    SDL_Rect aliens[ALIENS_COUNT][2];
+    SDL_Rect explosions[4];
+    SDL_Rect bullet;
+} t_spriteClips;
+
+// 1-bit alpha of a sprite clip, bit x of a row is pixel column x
+typedef struct
+{
+    t_u64 rows[SPRITE_CELL_H];
+    t_u8 w, h;
+} t_spriteMask;
+
 typedef struct
 {
     Mix_Chunk *playerShot;
     Mix_Chunk *playerExplosion;
     Mix_Chunk *alienExplosion;
+    Mix_Chunk *invadersMove;
+    Mix_Chunk *ufoHighPitch;
+    Mix_Chunk *ufoLowPitch;
 } t_audioData;
 
 typedef struct
 {
-    t_i16 x, y;
+    t_u32 tick;
+    t_u8 command;
+} t_timelineEvent;
+
+typedef struct
+{
+    // voice is free when it has no chunk
+    Mix_Chunk *chunk;
+    t_u32 position;
+    t_u64 startSample;
+    bool isUfo;
+} t_voice;
+
+// sounds keyed to simulation ticks and mixed by audio thread itself,
+// so that their rhythm doesn't depend on when frames are rendered
+typedef struct
+{
+    bool isEnabled;
+    int channels;
+    t_u32 frequency;
+    t_u32 samplesPerTick;
+    // events are played this late, hiding main thread jitter
+    t_u32 leadSamples;
+    // single producer (main thread), single consumer (audio thread)
+    t_timelineEvent events[AUDIO_TIMELINE_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    // fields below are used by audio thread only
+    t_u64 samplePosition;
+    bool isAnchored;
+    t_u32 anchorTick;
+    t_u64 anchorSample;
+    t_voice voices[AUDIO_MAX_VOICES];
+    // wall clock time when sample clockSample was asked for
+    bool hasClock;
+    Uint64 clockTime;
+    t_u64 clockSample;
+    // buffers asked for after the device had played everything before
+    SDL_atomic_t underruns;
+} t_audioTimeline;
+
+typedef struct
+{
+    // formations can be wider than 16-bit coordinates allow
+    t_i32 x, y;
 } t_position;
 
 typedef struct 
@@ -109,7 +312,9 @@ typedef struct
     t_position position;
     e_movingDirections movement;
     bool isShooting;
-    t_u32 lastShot;
+    // set while waiting for shoot cooldown timer
+    bool isReloading;
+    bool isInvincible;
     t_u32 lastHit;
     t_u8 lifes;
     t_u32 deathTime;
@@ -122,9 +327,13 @@ typedef struct
     t_u8 speed;
     // edges can be negative after recalculation
     // so use signed integer type
-    t_i16 leftEdge;
-    t_i16 rightEdge;
-    t_i16 bottomEdge;
+    t_i32 leftEdge;
+    t_i32 rightEdge;
+    t_i32 bottomEdge;
+    t_u32 aliveCount;
+    t_u32 hiddenCount;
+    // edges are recalculated only after some alien was hidden
+    bool hasHidden;
 } t_aliensData;
 
 typedef struct
@@ -139,14 +348,325 @@ typedef struct
     t_position position;
     e_entites entity;
     bool isVisible;
+    // bullet is already put into order by x
+    bool isSorted;
 } t_bulletData;
 
+// bullet in order by x, with copies of what sweeping needs,
+// so that sweep reads order alone
+typedef struct
+{
+    t_i32 x, y;
+    t_u32 bullet;
+    e_entites entity;
+} t_bulletKey;
+
+typedef struct
+{
+    bool isActive;
+    t_i32 x;
+    e_movingDirections moving;
+    t_u32 deathTime;
+    // tick when next ufo flies in
+    t_u32 nextTime;
+} t_ufoData;
+
+typedef struct
+{
+    t_u32 expires;
+    t_u8 kind;
+    t_u16 col, row;
+    // next timer in the same slot (or free list), -1 ends the list
+    t_i32 next;
+} t_timer;
+
+// hierarchical timer wheel: first level has a slot per tick,
+// second one a slot per TIMER_WHEEL_SLOTS ticks, which is moved down
+// to the first level when its turn comes. timers are linked by index
+// into timer pool, so both are plain data copied with the world
+typedef struct
+{
+    t_i32 slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    t_i32 freeTimer;
+    // next tick to be processed
+    t_u32 tick;
+} t_timerWheel;
+
+typedef struct
+{
+    // one bit per pixel, bit x of a row is pixel column x
+    t_u64 rows[SHIELD_H];
+    // area changed since last texture upload
+    bool isDirty;
+    SDL_Rect dirtyRect;
+} t_shieldData;
+
+// full copy of simulation state, used to roll out possible futures,
+// arrays are sized by formation and bullets limit set at launch
+typedef struct
+{
+    t_game game;
+    t_playerData playerData;
+    t_aliensData aliensData;
+    t_alienData *aliens;
+    t_ufoData ufoData;
+    t_shieldData shields[SHIELDS_COUNT];
+    t_timerWheel timers;
+    t_timer *timerPool;
+    t_bulletData *bullets;
+    t_bulletKey *bulletOrder;
+    t_u32 *shotBullets;
+} t_worldState;
+
+// size of the world, which grows with the formation
+typedef struct
+{
+    t_i32 w, h;
+    // world is scaled down to fit into SCREEN_W x SCREEN_H
+    float scale;
+    // horizontal bands bullets are split into before sweeping
+    t_u32 bulletBands;
+} t_world;
+
+typedef struct
+{
+    SDL_Thread *pThread;
+    SDL_sem *pStart;
+    t_u8 index;
+    t_u32 seed;
+    t_u32 rollouts;
+    t_i64 valueSum[AUTOPILOT_ACTION_COUNT];
+    t_u32 valueCount[AUTOPILOT_ACTION_COUNT];
+} t_autopilotWorker;
+
+typedef struct
+{
+    bool isEnabled;
+    bool isQuitting;
+    t_u8 action;
+    t_u8 workersCount;
+    t_autopilotWorker workers[AUTOPILOT_MAX_THREADS];
+    SDL_sem *pDone;
+    // state all workers start their rollouts from
+    t_worldState root;
+    Uint64 deadline;
+    Uint64 reportTime;
+    t_u32 reportRollouts;
+} t_autopilot;
+
+// string laid out into atlas quads, rebuilt only when its value changes
+typedef struct
+{
+    t_i32 value;
+    bool isValid;
+    t_u8 length;
+    SDL_Vertex vertices[HUD_TEXT_MAX * 4];
+} t_textRun;
+
+typedef struct
+{
+    SDL_Texture *pAtlas;
+    // index of every ascii character in atlas
+    t_u8 glyphIndex[128];
+    // indices of quads are the same for every run
+    int indices[HUD_TEXT_MAX * 6];
+    t_textRun scoreText;
+    t_textRun waveText;
+    t_textRun fpsText;
+    t_textRun replayText;
+    t_u32 fps;
+    t_u32 frames;
+    Uint64 fpsTime;
+} t_hud;
+
+typedef struct
+{
+    bool isEnabled;
+    // all counters are read at once through group leader
+    int groupFd;
+    int fds[PERF_EVENT_COUNT];
+    // position of event in group read, -1 if event is not available
+    t_i8 slots[PERF_EVENT_COUNT];
+    t_u8 openedCount;
+    t_u64 start[PERF_SUBSYSTEM_COUNT][PERF_EVENT_COUNT];
+    t_u64 total[PERF_SUBSYSTEM_COUNT][PERF_EVENT_COUNT];
+    t_u32 calls[PERF_SUBSYSTEM_COUNT];
+} t_perfCounters;
+
+typedef struct
+{
+    bool autopilot;
+    bool perf;
+    bool fullscreen;
+    // scale game by whole multiples only, otherwise fit with letterbox
+    bool integerScale;
+    t_u16 formationRows;
+    t_u16 formationCols;
+    t_u32 maxBullets;
+    const char *recordPath;
+    const char *replayPath;
+    t_u32 seekTick;
+    t_u16 spectateCount;
+    const char *telemetryName;
+    // replay is played as fast as possible without window and sound
+    bool headless;
+} t_options;
+
+// replay file is this header followed by a keyframe every keyframeTicks
+// ticks, each one followed by inputs of ticks up to the next keyframe.
+// structures are written as they are, so replays are read back only
+// by the same build, which is checked by sizes in header
+typedef struct
+{
+    char magic[8];
+    t_u32 version;
+    t_u32 keyframeSize;
+    // sum of sizes of array elements
+    t_u32 elementsSize;
+    t_u32 keyframeTicks;
+    t_u16 formationRows;
+    t_u16 formationCols;
+    t_u32 maxBullets;
+} t_replayHeader;
+
+// world at the start of a tick, followed by aliens, timer pool,
+// bullets, order of bullets and shot bullets, each one padded to 8 bytes
+typedef struct
+{
+    // whole keyframe with its arrays
+    t_u32 size;
+    t_game game;
+    t_playerData playerData;
+    t_aliensData aliensData;
+    t_ufoData ufoData;
+    t_shieldData shields[SHIELDS_COUNT];
+    t_timerWheel timers;
+} t_keyframe;
+
+typedef struct
+{
+    bool isRecording;
+    bool isPlaying;
+    bool isPaused;
+    // recording goes through stdio, keyframe is saved into state first
+    FILE *pFile;
+    t_worldState state;
+    // playback reads mapped file in place
+    const t_u8 *pData;
+    size_t size;
+    // offsets of complete keyframes in file
+    t_u64 *keyframes;
+    t_u32 keyframesCount;
+    t_u32 keyframeTicks;
+    // ticks from first keyframe to the end of recorded inputs
+    t_u32 firstTick;
+    t_u32 endTick;
+    // seek requested by scrubbing, done once per frame
+    bool hasSeek;
+    t_u32 seekTick;
+    bool isScrubbing;
+    // world was loaded from replay at least once
+    bool hasWorld;
+} t_replay;
+
+typedef struct
+{
+    t_worldState state;
+    bool isStarted;
+    // random player, as the one autopilot rolls out
+    t_u32 seed;
+    t_u8 action;
+    // what was seen last tick, change of it makes world interesting
+    t_u8 lifes;
+    t_u16 wave;
+    t_u32 interestTick;
+} t_spectatorWorld;
+
+typedef struct
+{
+    t_telemetryData *pData;
+    const char *name;
+    Uint64 frameTime;
+    // tick rate is measured over a second, as FPS is
+    Uint64 rateTime;
+    t_u32 rateTicks;
+    t_u32 ticksPerSecond;
+} t_telemetry;
+
+// many worlds stepped by autopilot workers and drawn as tiles of one frame
+typedef struct
+{
+    bool isEnabled;
+    t_u16 worldsCount;
+    t_spectatorWorld *worlds;
+    t_u16 cols;
+    t_u16 rows;
+    // scale of every world and offset of the current one in target
+    float scale;
+    float originX;
+    float originY;
+    // tile of the current world, its quads are clipped to it
+    SDL_Rect tile;
+    float textureW;
+    float textureH;
+    // opaque texel of spritesheet, shapes without sprite are drawn with it
+    SDL_FPoint solidTexel;
+    // sprites of all drawn worlds go in one submission
+    SDL_Vertex *vertices;
+    int *indices;
+    t_u32 quadsCount;
+    t_u32 quadsCapacity;
+    SDL_Rect *tileRects;
+    // tiles drawn this frame
+    SDL_Rect *clearRects;
+    // tiles not drawn in a frame keep what target had, unless target was lost
+    bool isRedrawAll;
+    t_u32 frames;
+    Uint64 reportTime;
+    t_u32 reportFrames;
+    t_u32 reportTiles;
+} t_spectator;
+
 // function prototypes
 bool initSDL();
 void close();
+bool parseArgs(int argc, char *argv[]);
 bool initGame();
 void startGame();
+void startWave();
+void startShields();
+void initWorldSize();
+bool initWorld();
+void closeWorld();
+bool initWorldState(t_worldState *state);
+void closeWorldState(t_worldState *state);
+inline t_alienData *getAlien(t_u16 col, t_u16 row);
+inline t_i32 formationX(const t_aliensData *aliensData, t_u16 col);
+inline t_i32 formationY(const t_aliensData *aliensData, t_u16 row);
+inline t_i32 floorDiv(t_i32 a, t_i32 b);
+t_i32 shieldX(t_u8 shield);
+t_u64 shiftMask(t_u64 mask, t_i16 shift);
+bool hitShields(t_bulletData *bullet);
+void markShieldDirty(t_shieldData *shield, t_i16 x, t_i16 y, t_i16 w, t_i16 h);
+bool initShieldsTexture();
+void updateShieldsTexture();
+void renderShields();
+void resetTimers();
+void addTimer(t_u8 kind, t_u32 delay, t_u16 col, t_u16 row);
+void insertTimer(t_i32 id);
+void updateTimers();
+void fireTimer(const t_timer *timer);
+void saveWorld(t_worldState *state);
+void loadWorld(const t_worldState *state);
+t_u32 nextRandom(t_u32 *state);
+void playSound(Mix_Chunk *chunk);
+bool initAudioTimeline();
+void scheduleSound(t_u8 command);
+void mixAudioTimeline(void *, Uint8 *stream, int length);
+void startVoice(Mix_Chunk *chunk, t_u64 startSample, bool isUfo);
 bool initSpritesData(char *path);
+bool initSpriteMask(SDL_Surface *rgba, const SDL_Rect *clip, t_spriteMask *mask);
+inline bool masksOverlap(const t_spriteMask *a, t_i32 ax, t_i32 ay, const t_spriteMask *b, t_i32 bx, t_i32 by);
 bool initAudioData();
 void handleEvents();
 void handleKeyStates();
@@ -155,36 +675,227 @@ void updatePlayer();
 void updateAliens();
 void updateAliensEdges();
 void updateBullets();
+void sortBullets();
+int compareBulletKeys(const void *a, const void *b);
+void collideBullets();
+inline t_u32 getBulletList(const t_bulletKey *key);
+void updateUfo();
+void hideUfo();
 void render();
+void presentTarget();
+void toggleFullscreen();
 void renderPlayer();
 void renderLifeBar();
 void renderAliens();
 void renderAlien();
 void renderBullets();
-void shoot(e_entites entity, t_u8 col, t_u8 row);
-void killAlien(t_u8 col, t_u8 row);
+void renderUfo();
+void renderSprite(const SDL_Rect *clip, const SDL_Rect *renderRect);
+bool initHud();
+void closeHud();
+void updateHud();
+void renderHud();
+void setTextRun(t_textRun *run, t_i16 x, t_i16 y, bool alignRight, const char *format, t_i32 value);
+void renderTextRun(const t_textRun *run);
+void shoot(e_entites entity, t_u16 col, t_u16 row);
+void killAlien(t_u16 col, t_u16 row);
 void hitPlayer();
+bool initAutopilot();
+void closeAutopilot();
+void updateAutopilot();
+void applyAutopilotAction(t_u8 action);
+t_i32 runRollout(t_u8 action, t_u32 *seed);
+int autopilotWorker(void *data);
+bool initPerfCounters();
+void closePerfCounters();
+void printPerfCounters();
+bool readPerfCounters(t_u64 *values);
+void perfBegin(t_u8 subsystem);
+void perfEnd(t_u8 subsystem);
+bool initRecording(const char *path);
+void recordTick();
+void writeKeyframe();
+size_t getKeyframeSize(const t_game *game);
+void writeReplayArray(const void *data, size_t size);
+inline size_t alignReplay(size_t size);
+bool initReplay(const char *path);
+void closeReplay();
+void viewKeyframe(const t_keyframe *keyframe, t_worldState *view);
+bool matchesWorld(const t_worldState *state);
+void seekReplay(t_u32 tick);
+void stepReplay();
+void updateReplay();
+bool runHeadless();
+bool handleReplayEvent(const SDL_Event *e);
+void scrubReplay(int windowX);
+void renderReplayBar();
+void getPresentRect(SDL_Rect *rect);
+bool initAutopilotWorkers();
+bool initSpectator();
+void closeSpectator();
+void stepSpectatorWorlds(t_u8 worker);
+void updateSpectator();
+void renderSpectator();
+void addSpectatorWorld(const t_worldState *state);
+bool reserveSpectatorQuads(t_u32 count);
+void addSpectatorQuad(const SDL_Rect *clip, float x, float y, float w, float h);
+const SDL_Rect *getAlienClip(const t_alienData *alien, t_u32 ticks);
+bool initTelemetry(const char *name);
+void closeTelemetry();
+void publishTelemetry();
 
 // globals
 t_SDLData g_SDLData;
-t_game g_game;
 t_spritesData g_spritesData;
 t_audioData g_audioData;
-t_playerData g_playerData;
-t_aliensData g_aliensData;
+t_autopilot g_autopilot;
+t_perfCounters g_perf;
+t_hud g_hud;
+t_options g_options;
+t_replay g_replay;
+t_spectator g_spectator;
+t_telemetry g_telemetry;
+t_world g_world;
+
+// characters baked into HUD atlas, unknown ones are drawn as space
+const char g_hudGlyphs[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ:.-";
+
+// 5x7 bitmap font, one byte per row, leftmost pixel in bit 4
+const t_u8 g_hudFont[][HUD_GLYPH_H] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }  // -
+};
+
+const char *g_perfSubsystemNames[PERF_SUBSYSTEM_COUNT] =
+{
+    "updateTimers",
+    "updatePlayer",
+    "updateAliens",
+    "updateAliensEdges",
+    "updateBullets",
+    "collideBullets",
+    "updateUfo",
+    "renderPlayer",
+    "renderLifeBar",
+    "renderAliens",
+    "renderBullets",
+    "renderUfo",
+    "renderShields",
+    "renderHud"
+};
+
+// spritesheet is a single column of cells, bullet is in the top-left corner of its one
+#define SPRITE_CELL(index) { 0, SPRITE_CELL_H * (index), SPRITE_CELL_W, SPRITE_CELL_H }
+
+const t_spriteClips g_clips =
+{
+    SPRITE_CELL(0),
+    SPRITE_CELL(1),
+    {
+        { SPRITE_CELL(2), SPRITE_CELL(3) },
+        { SPRITE_CELL(4), SPRITE_CELL(5) },
+        { SPRITE_CELL(6), SPRITE_CELL(7) },
+        { SPRITE_CELL(8), SPRITE_CELL(9) },
+        { SPRITE_CELL(10), SPRITE_CELL(11) }
+    },
+    { SPRITE_CELL(12), SPRITE_CELL(13), SPRITE_CELL(14), SPRITE_CELL(15) },
+    { 0, SPRITE_CELL_H * 16, BULLET_W, BULLET_H }
+};
 
-SDL_Rect g_alienClips[ALIENS_COUNT][2];
-SDL_Rect g_renderRects[ENTITY_COUNT];
+t_spriteMask g_alienMasks[ALIENS_COUNT][2];
+t_spriteMask g_playerMask;
+t_spriteMask g_bulletMask;
+t_spriteMask g_ufoMask;
+
+t_audioTimeline g_audioTimeline;
+
+// simulation state is thread local, so every autopilot worker
+// owns a private world it can roll out without locking
+thread_local t_game g_game;
+thread_local t_playerData g_playerData;
+thread_local t_aliensData g_aliensData;
+// formation is stored row by row, see getAlien()
+thread_local t_alienData *g_aliens;
+// bullet slot is free when bullet is not visible
+thread_local t_bulletData *g_bullets;
+// bullets sorted by x, followed by
+// as much room for newly shot ones to be merged in,
+// and a key past the end collideBullets may peek at
+thread_local t_bulletKey *g_bulletOrder;
+// where every band's list of player or aliens' bullets starts
+// in the second half of g_bulletOrder
+thread_local t_u32 *g_bulletLists;
+// list every key of g_bulletOrder goes to, from counting to placing them
+thread_local t_u32 *g_bulletKeyLists;
+// slots shot since bullets were last sorted, a slot that was freed
+// and shot again is listed twice, so it's not kept past a tick
+thread_local t_u32 *g_shotBullets;
+thread_local t_ufoData g_ufoData;
+thread_local t_shieldData g_shields[SHIELDS_COUNT];
+thread_local t_timerWheel g_timers;
+thread_local t_timer *g_timerPool;
+
+// shape of damage done by a bullet, centered on its impact point
+const t_u64 g_craterMask[SHIELD_CRATER_H] =
+{
+    0x24, // ..#..#..
+    0x5A, // .#.##.#.
+    0x7E, // .######.
+    0xFF, // ########
+    0x7E, // .######.
+    0xA5  // #.#..#.#
+};
 
-t_alienData g_aliens[ALIENS_COUNT][ALIENS_IN_ROW];
-t_bulletData *g_bullets[MAX_BULLETS];
+// rollouts must not be heard
+thread_local bool g_isMuted;
+// hardware counters are opened for one thread only
+thread_local bool g_isPerfThread;
 
 bool initSDL()
 {
     int imageFlags = IMG_INIT_PNG;
 
-    // init SDl
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+    // init SDl, headless game needs neither video nor audio
+    if (SDL_Init(g_options.headless ? 0 : SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
     {
         printf("SDL could not initialize! SDL_Error: %s!\n", SDL_GetError());
         return false;
@@ -197,6 +908,13 @@ bool initSDL()
         return false;
     }
 
+    // null renderer, no window and no sounds
+    if (g_options.headless)
+    {
+        g_isMuted = true;
+        return true;
+    }
+
     // init SDL_mixer
     if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
     {
@@ -210,7 +928,8 @@ bool initSDL()
         SDL_WINDOWPOS_UNDEFINED,
         SDL_WINDOWPOS_UNDEFINED,
         SCREEN_W, SCREEN_H,
-        SDL_WINDOW_SHOWN);
+        SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI |
+            (g_options.fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0));
     if (g_SDLData.pWindow == NULL)
     {
         printf("Window could not be created! SDL_Error: %s!\n", SDL_GetError());
@@ -218,7 +937,8 @@ bool initSDL()
     }
 
     // init renderer
-    g_SDLData.pRenderer = SDL_CreateRenderer(g_SDLData.pWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    g_SDLData.pRenderer = SDL_CreateRenderer(g_SDLData.pWindow, -1, 
+        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
     if (g_SDLData.pRenderer == NULL)
     {
         printf("Renderer could not be created! SDL_Error: %s!\n", SDL_GetError());
@@ -226,6 +946,21 @@ bool initSDL()
     }
     else SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0x00, 0x00, 0x00, 0xFF);
 
+    // keep pixels sharp when target is scaled up
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+
+    // init render target, its size doesn't depend on window size
+    g_SDLData.pTarget = SDL_CreateTexture(
+        g_SDLData.pRenderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET,
+        SCREEN_W, SCREEN_H);
+    if (g_SDLData.pTarget == NULL)
+    {
+        printf("Render target could not be created! SDL_Error: %s!\n", SDL_GetError());
+        return false;
+    }
+
     return true;
 }
 
@@ -233,12 +968,39 @@ void close()
 {
     // TODO: free sprites data 
     
+    // workers step spectator worlds, so they are stopped first
+    closeAutopilot();
+    closeSpectator();
+    closeReplay();
+    closeTelemetry();
+    closeHud();
+    closeWorld();
+
+    if (g_spritesData.pShieldsTexture != NULL)
+        SDL_DestroyTexture(g_spritesData.pShieldsTexture);
+    g_spritesData.pShieldsTexture = NULL;
+
+    if (g_perf.isEnabled)
+        printPerfCounters();
+    closePerfCounters();
+
+    // stop mixing timeline before its sounds are freed
+    if (g_audioTimeline.isEnabled)
+        Mix_SetPostMix(NULL, NULL);
+    g_audioTimeline.isEnabled = false;
+
     // free audio
     Mix_FreeChunk(g_audioData.playerShot);
     Mix_FreeChunk(g_audioData.playerExplosion);
     Mix_FreeChunk(g_audioData.alienExplosion);
+    Mix_FreeChunk(g_audioData.invadersMove);
+    Mix_FreeChunk(g_audioData.ufoHighPitch);
+    Mix_FreeChunk(g_audioData.ufoLowPitch);
 
     // destroy window
+    if (g_SDLData.pTarget != NULL)
+        SDL_DestroyTexture(g_SDLData.pTarget);
+    g_SDLData.pTarget = NULL;
     SDL_DestroyWindow(g_SDLData.pWindow);
     SDL_DestroyRenderer(g_SDLData.pRenderer);
     g_SDLData.pWindow = NULL;
@@ -249,9 +1011,132 @@ void close()
     SDL_Quit();
 }
 
+bool parseArgs(int argc, char *argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--autopilot") == 0)
+        {
+            g_options.autopilot = true;
+        }
+        else if (strcmp(argv[i], "--perf") == 0)
+        {
+            g_options.perf = true;
+        }
+        else if (strcmp(argv[i], "--fullscreen") == 0)
+        {
+            g_options.fullscreen = true;
+        }
+        else if (strcmp(argv[i], "--integer-scale") == 0)
+        {
+            g_options.integerScale = true;
+        }
+        else if (strcmp(argv[i], "--formation") == 0 && i + 1 < argc)
+        {
+            int rows, cols;
+
+            if (sscanf(argv[++i], "%dx%d", &rows, &cols) != 2 ||
+                rows < 1 || rows > FORMATION_MAX_ROWS || cols < 1 || cols > FORMATION_MAX_COLS)
+            {
+                printf("Formation must be ROWSxCOLS, up to %dx%d\n", FORMATION_MAX_ROWS, FORMATION_MAX_COLS);
+                return false;
+            }
+
+            g_options.formationRows = rows;
+            g_options.formationCols = cols;
+        }
+        else if (strcmp(argv[i], "--bullets") == 0 && i + 1 < argc)
+        {
+            int bullets = atoi(argv[++i]);
+
+            if (bullets < 1 || bullets > BULLETS_LIMIT)
+            {
+                printf("Bullets limit must be from 1 to %d\n", BULLETS_LIMIT);
+                return false;
+            }
+
+            g_options.maxBullets = bullets;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            g_options.recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            g_options.replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc)
+        {
+            g_options.seekTick = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--spectate") == 0 && i + 1 < argc)
+        {
+            int count = atoi(argv[++i]);
+
+            if (count < 1 || count > SPECTATOR_MAX_WORLDS)
+            {
+                printf("Spectated worlds must be from 1 to %d\n", SPECTATOR_MAX_WORLDS);
+                return false;
+            }
+
+            g_options.spectateCount = count;
+        }
+        else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+        {
+            g_options.telemetryName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            g_options.headless = true;
+        }
+        else
+        {
+            printf("Unknown option '%s'\n", argv[i]);
+            printf("Usage: %s [--autopilot] [--perf] [--fullscreen] [--integer-scale] "
+                "[--formation ROWSxCOLS] [--bullets N] [--record FILE] [--replay FILE [--seek TICK]] [--spectate N] [--telemetry NAME] [--headless]\n", argv[0]);
+            return false;
+        }
+    }
+
+    if (g_options.recordPath != NULL && g_options.replayPath != NULL)
+    {
+        printf("Replay can't be recorded while another one is played\n");
+        return false;
+    }
+
+    if (g_options.seekTick > 0 && g_options.replayPath == NULL)
+    {
+        printf("Seeking needs a replay to be played\n");
+        return false;
+    }
+
+    if (g_options.spectateCount > 0 &&
+        (g_options.autopilot || g_options.recordPath != NULL || g_options.replayPath != NULL))
+    {
+        printf("Spectated worlds play on their own, without autopilot or replays\n");
+        return false;
+    }
+
+    if (g_options.spectateCount > 0 && g_options.telemetryName != NULL)
+    {
+        printf("Telemetry is published by a single game, not by spectated worlds\n");
+        return false;
+    }
+
+    if (g_options.headless && (g_options.replayPath == NULL || g_options.recordPath != NULL))
+    {
+        printf("Headless mode needs a replay to be played\n");
+        return false;
+    }
+
+    return true;
+}
+
 bool initGame()
 {
-    srand(time(NULL));
+    g_game.rngState = time(NULL) | 1;
     
     // init sprites
     g_spritesData.pTexture = NULL;
@@ -263,18 +1148,76 @@ bool initGame()
         return false;
     }
 
+    // replay brings formation and bullets limit it was recorded with
+    if (g_options.replayPath != NULL && !initReplay(g_options.replayPath))
+    {
+        printf("Replay init error\n");
+        return false;
+    }
+
+    // world size depends on sprite sizes
+    initWorldSize();
+    if (!initWorld())
+    {
+        printf("World init error\n");
+        return false;
+    }
+
     // init audio
     g_audioData.playerShot = NULL;
     g_audioData.playerExplosion = NULL;
     g_audioData.alienExplosion = NULL;
+    g_audioData.invadersMove = NULL;
+    g_audioData.ufoHighPitch = NULL;
+    g_audioData.ufoLowPitch = NULL;
 
-    if (!initAudioData())
+    // sounds can't be loaded without audio device
+    if (!g_options.headless && !initAudioData())
     {
         printf("Audio init error\n");
         return false;
     }
 
+    if (!initHud())
+    {
+        printf("HUD init error\n");
+        return false;
+    }
+
+    if (!initShieldsTexture())
+    {
+        printf("Shields init error\n");
+        return false;
+    }
+
     g_game.ticks = 0;
+
+    if (g_options.recordPath != NULL && !initRecording(g_options.recordPath))
+    {
+        printf("Recording init error\n");
+        return false;
+    }
+
+    // replay is played without autopilot
+    if (g_options.autopilot && !g_replay.isPlaying && !initAutopilot())
+    {
+        printf("Autopilot init error\n");
+        return false;
+    }
+
+    if (g_options.spectateCount > 0 && !initSpectator())
+    {
+        printf("Spectator init error\n");
+        return false;
+    }
+
+    // game runs fine without counters
+    if (g_options.perf && !initPerfCounters())
+        printf("Hardware performance counters are not available\n");
+
+    if (g_options.telemetryName != NULL && !initTelemetry(g_options.telemetryName))
+        printf("Telemetry is not published\n");
+
     g_game.isRunning = true;
 
     return true;
@@ -290,116 +1233,109 @@ bool initSpritesData(char *path)
         return false;
     }
 
-    g_spritesData.pTexture = SDL_CreateTextureFromSurface(g_SDLData.pRenderer, surface);
-    if (g_spritesData.pTexture == NULL)
+    // without renderer only collision masks are needed
+    if (g_SDLData.pRenderer != NULL)
     {
-        printf("Unable to create texture from %s! SDL_Error: %s\n", path, SDL_GetError());
-        return false;
+        g_spritesData.pTexture = SDL_CreateTextureFromSurface(g_SDLData.pRenderer, surface);
+        if (g_spritesData.pTexture == NULL)
+        {
+            printf("Unable to create texture from %s! SDL_Error: %s\n", path, SDL_GetError());
+            SDL_FreeSurface(surface);
+            return false;
+        }
     }
+
+    // collision masks are taken from decoded image while it's still around,
+    // pixels are read in one known format whatever the image format is
+    SDL_Surface *rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
     SDL_FreeSurface(surface);
 
-    // init clip rects for all entities
-    g_spritesData.playerClip[0].w = SPRITE_CELL_W;
-    g_spritesData.playerClip[0].h = SPRITE_CELL_H;
-    g_spritesData.playerClip[0].x = 0;
-    g_spritesData.playerClip[0].y = 0;
-
-    g_spritesData.ufoClip[0].w = SPRITE_CELL_W;
-    g_spritesData.ufoClip[0].h = SPRITE_CELL_H;
-    g_spritesData.ufoClip[0].x = 0;
-    g_spritesData.ufoClip[0].y = SPRITE_CELL_H;
-
-    g_alienClips[ALIEN_1][0].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_1][0].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_1][0].x = 0;
-    g_alienClips[ALIEN_1][0].y = SPRITE_CELL_H * 2;
-    g_alienClips[ALIEN_1][1].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_1][1].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_1][1].x = 0;
-    g_alienClips[ALIEN_1][1].y = SPRITE_CELL_H * 3;
-
-    g_alienClips[ALIEN_2][0].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_2][0].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_2][0].x = 0;
-    g_alienClips[ALIEN_2][0].y = SPRITE_CELL_H * 4;
-    g_alienClips[ALIEN_2][1].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_2][1].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_2][1].x = 0;
-    g_alienClips[ALIEN_2][1].y = SPRITE_CELL_H * 5;
-
-    g_alienClips[ALIEN_3][0].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_3][0].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_3][0].x = 0;
-    g_alienClips[ALIEN_3][0].y = SPRITE_CELL_H * 6;
-    g_alienClips[ALIEN_3][1].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_3][1].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_3][1].x = 0;
-    g_alienClips[ALIEN_3][1].y = SPRITE_CELL_H * 7;
-
-    g_alienClips[ALIEN_4][0].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_4][0].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_4][0].x = 0;
-    g_alienClips[ALIEN_4][0].y = SPRITE_CELL_H * 8;
-    g_alienClips[ALIEN_4][1].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_4][1].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_4][1].x = 0;
-    g_alienClips[ALIEN_4][1].y = SPRITE_CELL_H * 9;
-
-    g_alienClips[ALIEN_5][0].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_5][0].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_5][0].x = 0;
-    g_alienClips[ALIEN_5][0].y = SPRITE_CELL_H * 10;
-    g_alienClips[ALIEN_5][1].w = SPRITE_CELL_W;
-    g_alienClips[ALIEN_5][1].h = SPRITE_CELL_H;
-    g_alienClips[ALIEN_5][1].x = 0;
-    g_alienClips[ALIEN_5][1].y = SPRITE_CELL_H * 11;
-
-    g_spritesData.explosionClip[0].w = SPRITE_CELL_W;
-    g_spritesData.explosionClip[0].h = SPRITE_CELL_H;
-    g_spritesData.explosionClip[0].x = 0;
-    g_spritesData.explosionClip[0].y = SPRITE_CELL_H * 12;
-    g_spritesData.explosionClip[1].w = SPRITE_CELL_W;
-    g_spritesData.explosionClip[1].h = SPRITE_CELL_H;
-    g_spritesData.explosionClip[1].x = 0;
-    g_spritesData.explosionClip[1].y = SPRITE_CELL_H * 13;
-    g_spritesData.explosionClip[2].w = SPRITE_CELL_W;
-    g_spritesData.explosionClip[2].h = SPRITE_CELL_H;
-    g_spritesData.explosionClip[2].x = 0;
-    g_spritesData.explosionClip[2].y = SPRITE_CELL_H * 14;
-    g_spritesData.explosionClip[3].w = SPRITE_CELL_W;
-    g_spritesData.explosionClip[3].h = SPRITE_CELL_H;
-    g_spritesData.explosionClip[3].x = 0;
-    g_spritesData.explosionClip[3].y = SPRITE_CELL_H * 15;
-
-    g_spritesData.bulletClip[0].w = 4;
-    g_spritesData.bulletClip[0].h = 12;
-    g_spritesData.bulletClip[0].x = 0;
-    g_spritesData.bulletClip[0].y = SPRITE_CELL_H * 16;
-
-    // init render rects for all entities
-    g_renderRects[PLAYER_ENTITY].w = g_spritesData.playerClip[0].w;
-    g_renderRects[PLAYER_ENTITY].h = g_spritesData.playerClip[0].h;
-    g_renderRects[PLAYER_ENTITY].x = 0;
-    g_renderRects[PLAYER_ENTITY].y = 0;
-
-    g_renderRects[ALIEN_ENTITY].w = g_alienClips[ALIEN_1][0].w;
-    g_renderRects[ALIEN_ENTITY].h = g_alienClips[ALIEN_1][0].h;
-    g_renderRects[ALIEN_ENTITY].x = 0;
-    g_renderRects[ALIEN_ENTITY].y = 0;
-
-    g_renderRects[BULLET_ENTITY].w = 4;
-    g_renderRects[BULLET_ENTITY].h = 12;
-    g_renderRects[BULLET_ENTITY].x = 0;
-    g_renderRects[BULLET_ENTITY].y = 0;
-
-    g_renderRects[PLAYER_LIFE_ENTITY].w = g_renderRects[PLAYER_ENTITY].w / 1.5;
-    g_renderRects[PLAYER_LIFE_ENTITY].h = g_renderRects[PLAYER_ENTITY].h / 1.5;
-    g_renderRects[PLAYER_LIFE_ENTITY].x = 0;
-    g_renderRects[PLAYER_LIFE_ENTITY].y = 0;
+    if (rgba == NULL)
+    {
+        printf("Unable to convert sprites surface! SDL_Error: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_LockSurface(rgba);
+
+    t_u8 alien, frame;
+    bool hasMasks = initSpriteMask(rgba, &g_clips.player, &g_playerMask) &&
+        initSpriteMask(rgba, &g_clips.bullet, &g_bulletMask) &&
+        initSpriteMask(rgba, &g_clips.ufo, &g_ufoMask);
+
+    for (alien = 0; alien < ALIENS_COUNT; alien++)
+        for (frame = 0; frame < 2; frame++)
+            hasMasks = hasMasks && initSpriteMask(rgba, &g_clips.aliens[alien][frame], &g_alienMasks[alien][frame]);
+
+    SDL_UnlockSurface(rgba);
+    SDL_FreeSurface(rgba);
+
+    return hasMasks;
+}
+
+// surface is locked RGBA32
+bool initSpriteMask(SDL_Surface *rgba, const SDL_Rect *clip, t_spriteMask *mask)
+{
+    t_u8 row, col;
+
+    if (clip->w > 64 || clip->h > SPRITE_CELL_H)
+    {
+        printf("Sprite clip %dx%d is too big for collision mask\n", clip->w, clip->h);
+        return false;
+    }
+
+    mask->w = clip->w;
+    mask->h = clip->h;
+    memset(mask->rows, 0, sizeof(mask->rows));
+
+    for (row = 0; row < clip->h; row++)
+        for (col = 0; col < clip->w; col++)
+        {
+            Uint8 r, g, b, a;
+            Uint32 pixel = *(Uint32 *)((Uint8 *)rgba->pixels + 
+                (clip->y + row) * rgba->pitch + (clip->x + col) * sizeof(Uint32));
+
+            // sprites sit on opaque black, so black is empty as well as transparent
+            SDL_GetRGBA(pixel, rgba->format, &r, &g, &b, &a);
+            if (a >= SPRITE_MASK_ALPHA && (r | g | b) != 0)
+                mask->rows[row] |= (t_u64)1 << col;
+        }
 
     return true;
 }
 
+inline bool masksOverlap(const t_spriteMask *a, t_i32 ax, t_i32 ay, const t_spriteMask *b, t_i32 bx, t_i32 by)
+{
+    t_i16 y;
+
+    // bounding boxes reject most of pairs
+    if (ax >= bx + b->w || bx >= ax + a->w ||
+        ay >= by + b->h || by >= ay + a->h)
+    {
+        return false;
+    }
+
+    // compare overlapping rows with b shifted into a's columns,
+    // boxes overlap so shift is always less than 64
+    t_i32 top = SDL_max(ay, by);
+    t_i32 bottom = SDL_min(ay + a->h, by + b->h);
+    const t_u64 *aRows = &a->rows[top - ay];
+    const t_u64 *bRows = &b->rows[top - by];
+    t_u64 overlap = 0;
+
+    if (bx >= ax)
+    {
+        for (y = 0; y < bottom - top; y++)
+            overlap |= aRows[y] & (bRows[y] << (bx - ax));
+    }
+    else
+    {
+        for (y = 0; y < bottom - top; y++)
+            overlap |= aRows[y] & (bRows[y] >> (ax - bx));
+    }
+
+    return overlap != 0;
+}
+
 bool initAudioData()
 {
     g_audioData.playerShot = Mix_LoadWAV("assets/audio/player-shot.wav");
@@ -423,21 +1359,253 @@ bool initAudioData()
         return false;
     }  
 
+    g_audioData.invadersMove = Mix_LoadWAV("assets/audio/invaders-move.wav");
+    if (g_audioData.invadersMove == NULL)
+    {
+        printf("Failed to load 'invaders-move' sound effect! SDL_mixer error: %s\n", Mix_GetError());
+        return false;
+    }  
+
+    g_audioData.ufoHighPitch = Mix_LoadWAV("assets/audio/ufo-highpitch.wav");
+    if (g_audioData.ufoHighPitch == NULL)
+    {
+        printf("Failed to load 'ufo-highpitch' sound effect! SDL_mixer error: %s\n", Mix_GetError());
+        return false;
+    }  
+
+    g_audioData.ufoLowPitch = Mix_LoadWAV("assets/audio/ufo-lowpitch.wav");
+    if (g_audioData.ufoLowPitch == NULL)
+    {
+        printf("Failed to load 'ufo-lowpitch' sound effect! SDL_mixer error: %s\n", Mix_GetError());
+        return false;
+    }  
+
+    // game is still playable without timeline sounds
+    if (!initAudioTimeline())
+        printf("March and ufo sounds are disabled\n");
+
     return true;
 }
 
-void startGame()
+bool initAudioTimeline()
 {
-    // init player data
-    g_playerData.position.x = SCREEN_W / 2 - g_renderRects[PLAYER_ENTITY].w / 2;
-    g_playerData.position.y = SCREEN_H - SPRITE_CELL_H;
+    int frequency, channels;
+    Uint16 format;
+
+    if (!Mix_QuerySpec(&frequency, &format, &channels))
+    {
+        printf("Unable to query audio format! SDL_mixer error: %s\n", Mix_GetError());
+        return false;
+    }
+
+    // timeline mixes samples itself and knows only the default format
+    if (format != AUDIO_S16SYS)
+    {
+        printf("Audio timeline supports only 16-bit audio\n");
+        return false;
+    }
+
+    g_audioTimeline.channels = channels;
+    g_audioTimeline.frequency = frequency;
+    g_audioTimeline.samplesPerTick = frequency / TICKS_PER_SECOND;
+    g_audioTimeline.leadSamples = frequency / 20;
+    SDL_AtomicSet(&g_audioTimeline.head, 0);
+    SDL_AtomicSet(&g_audioTimeline.tail, 0);
+    g_audioTimeline.samplePosition = 0;
+    g_audioTimeline.isAnchored = false;
+    memset(g_audioTimeline.voices, 0, sizeof(g_audioTimeline.voices));
+    g_audioTimeline.hasClock = false;
+    SDL_AtomicSet(&g_audioTimeline.underruns, 0);
+    g_audioTimeline.isEnabled = true;
+
+    Mix_SetPostMix(mixAudioTimeline, NULL);
+
+    return true;
+}
+
+void scheduleSound(t_u8 command)
+{
+    if (g_isMuted || !g_audioTimeline.isEnabled)
+        return;
+
+    int head = SDL_AtomicGet(&g_audioTimeline.head);
+    int next = (head + 1) % AUDIO_TIMELINE_SIZE;
+
+    // drop event if audio thread is that far behind
+    if (next == SDL_AtomicGet(&g_audioTimeline.tail))
+        return;
+
+    g_audioTimeline.events[head].tick = g_game.ticks;
+    g_audioTimeline.events[head].command = command;
+
+    // publish event only after it is written
+    SDL_AtomicSet(&g_audioTimeline.head, next);
+}
+
+void mixAudioTimeline(void *, Uint8 *stream, int length)
+{
+    t_audioTimeline *timeline = &g_audioTimeline;
+    Sint16 *samples = (Sint16 *)stream;
+    t_u32 frames = length / (sizeof(Sint16) * timeline->channels);
+    t_u64 bufferStart = timeline->samplePosition;
+    t_u64 bufferEnd = bufferStart + frames;
+    t_u8 i;
+
+    // device ran dry, if this buffer is asked for more than a buffer later
+    // than everything mixed before would have been played, clock starts over then
+    Uint64 now = SDL_GetPerformanceCounter();
+    double playedTime = timeline->clockTime +
+        (double)(bufferStart - timeline->clockSample) * SDL_GetPerformanceFrequency() / timeline->frequency;
+
+    if (!timeline->hasClock ||
+        now > playedTime + (double)frames * SDL_GetPerformanceFrequency() / timeline->frequency)
+    {
+        if (timeline->hasClock)
+            SDL_AtomicIncRef(&timeline->underruns);
+
+        timeline->hasClock = true;
+        timeline->clockTime = now;
+        timeline->clockSample = bufferStart;
+    }
+
+    // start voices of events that fall into this buffer
+    while (SDL_AtomicGet(&timeline->tail) != SDL_AtomicGet(&timeline->head))
+    {
+        int tail = SDL_AtomicGet(&timeline->tail);
+        t_timelineEvent *event = &timeline->events[tail];
+        t_u64 target = bufferStart + timeline->leadSamples;
+
+        // tick t is played at anchorSample + (t - anchorTick) * samplesPerTick,
+        // anchor is moved only if simulation got too far from audio clock
+        t_u64 eventSample = timeline->anchorSample + 
+            (t_u64)(event->tick - timeline->anchorTick) * timeline->samplesPerTick;
+
+        if (!timeline->isAnchored || event->tick < timeline->anchorTick ||
+            eventSample + timeline->leadSamples < target ||
+            eventSample > target + timeline->leadSamples)
+        {
+            timeline->isAnchored = true;
+            timeline->anchorTick = event->tick;
+            timeline->anchorSample = target;
+            eventSample = target;
+        }
+
+        if (eventSample >= bufferEnd)
+            break;
+
+        if (event->command == TIMELINE_MARCH)
+        {
+            startVoice(g_audioData.invadersMove, eventSample, false);
+        }
+        else if (event->command == TIMELINE_UFO_START)
+        {
+            startVoice(g_audioData.ufoHighPitch, eventSample, true);
+        }
+        else if (event->command == TIMELINE_UFO_STOP)
+        {
+            for (i = 0; i < AUDIO_MAX_VOICES; i++)
+                if (timeline->voices[i].isUfo)
+                    timeline->voices[i].chunk = NULL;
+        }
+
+        SDL_AtomicSet(&timeline->tail, (tail + 1) % AUDIO_TIMELINE_SIZE);
+    }
+
+    // add voices on top of what mixer has already mixed
+    for (i = 0; i < AUDIO_MAX_VOICES; i++)
+    {
+        t_voice *voice = &timeline->voices[i];
+        t_u64 frame = SDL_max(voice->startSample, bufferStart);
+
+        while (voice->chunk != NULL && frame < bufferEnd)
+        {
+            Sint16 *source = (Sint16 *)voice->chunk->abuf;
+            t_u32 sourceLength = voice->chunk->alen / sizeof(Sint16);
+            t_u32 out = (frame - bufferStart) * timeline->channels;
+
+            for (; frame < bufferEnd && voice->position < sourceLength; frame++)
+            {
+                t_u8 channel;
+
+                for (channel = 0; channel < timeline->channels; channel++, out++)
+                {
+                    int value = samples[out] + source[voice->position++];
+                    samples[out] = SDL_max(SDL_min(value, 32767), -32768);
+                }
+            }
+
+            // ufo siren loops alternating pitches, other sounds stop
+            if (voice->position >= sourceLength)
+            {
+                voice->position = 0;
+                voice->chunk = !voice->isUfo ? NULL :
+                    voice->chunk == g_audioData.ufoHighPitch ? g_audioData.ufoLowPitch : g_audioData.ufoHighPitch;
+            }
+        }
+    }
+
+    timeline->samplePosition = bufferEnd;
+}
+
+void startVoice(Mix_Chunk *chunk, t_u64 startSample, bool isUfo)
+{
+    t_u8 i;
+
+    for (i = 0; i < AUDIO_MAX_VOICES; i++)
+        if (g_audioTimeline.voices[i].chunk == NULL)
+        {
+            g_audioTimeline.voices[i].chunk = chunk;
+            g_audioTimeline.voices[i].position = 0;
+            g_audioTimeline.voices[i].startSample = startSample;
+            g_audioTimeline.voices[i].isUfo = isUfo;
+            break;
+        }
+}
+
+void startGame()
+{
+    // init player data
+    g_playerData.position.x = g_world.w / 2 - PLAYER_W / 2;
+    g_playerData.position.y = g_world.h - SPRITE_CELL_H;
     g_playerData.movement = NOT_MOVING;
     g_playerData.isShooting = false;
-    g_playerData.lastShot = 0;
+    g_playerData.isReloading = false;
+    g_playerData.isInvincible = false;
     g_playerData.lastHit = 0;
     g_playerData.lifes = PLAYER_MAX_LIFES;
     g_playerData.deathTime = 0;
 
+    // timers of previous game must not fire in this one
+    resetTimers();
+
+    g_game.score = 0;
+    g_game.wave = 0;
+    startWave();
+    startShields();
+
+    // init ufo data
+    if (g_ufoData.isActive)
+        scheduleSound(TIMELINE_UFO_STOP);
+    g_ufoData.isActive = false;
+    g_ufoData.deathTime = 0;
+    g_ufoData.nextTime = g_game.ticks + UFO_INTERVAL;
+
+    // free bullets of previous game
+    t_u32 i;
+    for (i = 0; i < g_game.lastBullet; i++)
+        g_bullets[i].isVisible = false;
+
+    g_game.lastBullet = 0;
+    g_game.freeBullet = 0;
+    g_game.sortedBullets = 0;
+    g_game.shotBullets = 0;
+    g_game.visibleBullets = 0;
+}
+
+void startWave()
+{
+    g_game.wave++;
+
     // init aliens data
     g_aliensData.moving = MOVING_RIGHT;
     g_aliensData.speed = ALIENS_INITIAL_SPEED;
@@ -445,91 +1613,401 @@ void startGame()
     g_aliensData.position.y = 0;
 
     g_aliensData.leftEdge = 0;
+    g_aliensData.aliveCount = g_options.formationRows * g_options.formationCols;
+    g_aliensData.hiddenCount = 0;
+    g_aliensData.hasHidden = false;
 
     // sum of all alien widths and horizantal spacings
-    g_aliensData.rightEdge = ALIENS_IN_ROW * 
-        (g_renderRects[ALIEN_ENTITY].w + ALIENS_COL_SPACING) -
-        ALIENS_COL_SPACING;
+    g_aliensData.rightEdge = g_options.formationCols * ALIEN_CELL_W - ALIENS_COL_SPACING;
 
     // sum of all alien heights and vertical spacings
-    g_aliensData.bottomEdge = ALIENS_COUNT *
-        (g_renderRects[ALIEN_ENTITY].h + ALIENS_ROW_SPACING) -
-        ALIENS_ROW_SPACING;
+    g_aliensData.bottomEdge = g_options.formationRows * ALIEN_CELL_H - ALIENS_ROW_SPACING;
 
-    t_u8 row, col;
-    for (row = 0; row < ALIENS_COUNT; row++)
-        for (col = 0; col < ALIENS_IN_ROW; col++)
+    t_u16 row, col;
+    for (row = 0; row < g_options.formationRows; row++)
+        for (col = 0; col < g_options.formationCols; col++)
         {
-            g_aliens[row][col].entity = row;
-            g_aliens[row][col].deathTime = 0;
-            g_aliens[row][col].isHidden = false;
+            t_alienData *alien = getAlien(col, row);
+
+            // kinds of aliens repeat in bigger formations
+            alien->entity = row % ALIENS_COUNT;
+            alien->deathTime = 0;
+            alien->isHidden = false;
         }
+}
 
-    // init bullets data
-    t_u8 i;
-    for (i = 0; i < MAX_BULLETS; i++)
-    {
-        // free bullets of previous game
-        if (g_bullets[i] != NULL)
-            free(g_bullets[i]);
+void initWorldSize()
+{
+    // default formation fits the screen, bigger ones grow the world
+    // by their extra size, leaving the same room to move around
+    if (g_options.formationRows == 0)
+        g_options.formationRows = ALIENS_COUNT;
+    if (g_options.formationCols == 0)
+        g_options.formationCols = ALIENS_IN_ROW;
+    if (g_options.maxBullets == 0)
+        g_options.maxBullets = MAX_BULLETS;
+
+    g_world.w = SCREEN_W + SDL_max(g_options.formationCols - ALIENS_IN_ROW, 0) * ALIEN_CELL_W;
+    g_world.h = SCREEN_H + SDL_max(g_options.formationRows - ALIENS_COUNT, 0) * ALIEN_CELL_H;
+    g_world.scale = SDL_min((float)SCREEN_W / g_world.w, (float)SCREEN_H / g_world.h);
+    // bullets are kept within BULLET_H * 2 of the world
+    g_world.bulletBands = (g_world.h + BULLET_H * 4) / BULLET_BAND_H + 2;
+}
 
-        g_bullets[i] = NULL;
+bool initWorld()
+{
+    // every thread simulating a world has its own storage
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+
+    g_aliens = (t_alienData *)calloc(aliensCount, sizeof(t_alienData));
+    g_timerPool = (t_timer *)calloc(aliensCount + EXTRA_TIMERS, sizeof(t_timer));
+    g_bullets = (t_bulletData *)calloc(g_options.maxBullets, sizeof(t_bulletData));
+    g_bulletOrder = (t_bulletKey *)calloc(g_options.maxBullets * 2 + 1, sizeof(t_bulletKey));
+    // two lists per band and band past the last one, plus counting sort's room
+    g_bulletLists = (t_u32 *)calloc(g_world.bulletBands * 2 + 4, sizeof(t_u32));
+    g_bulletKeyLists = (t_u32 *)calloc(g_options.maxBullets, sizeof(t_u32));
+    g_shotBullets = (t_u32 *)calloc(g_options.maxBullets, sizeof(t_u32));
+
+    if (g_aliens == NULL || g_timerPool == NULL || g_bullets == NULL || g_bulletOrder == NULL ||
+        g_bulletLists == NULL || g_bulletKeyLists == NULL || g_shotBullets == NULL)
+    {
+        printf("Unable to allocate world for %u aliens and %u bullets\n", aliensCount, g_options.maxBullets);
+        closeWorld();
+        return false;
     }
+
     g_game.lastBullet = 0;
+    g_game.freeBullet = 0;
+    g_game.sortedBullets = 0;
+    g_game.shotBullets = 0;
+    g_game.visibleBullets = 0;
+
+    return true;
 }
 
-void shoot(e_entites entity, t_u8 col, t_u8 row)
+void closeWorld()
 {
-    t_u8 i;
+    free(g_aliens);
+    free(g_timerPool);
+    free(g_bullets);
+    free(g_bulletOrder);
+    free(g_bulletLists);
+    free(g_bulletKeyLists);
+    free(g_shotBullets);
+    g_aliens = NULL;
+    g_timerPool = NULL;
+    g_bullets = NULL;
+    g_bulletOrder = NULL;
+    g_bulletLists = NULL;
+    g_bulletKeyLists = NULL;
+    g_shotBullets = NULL;
+}
+
+bool initWorldState(t_worldState *state)
+{
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+
+    state->aliens = (t_alienData *)malloc(aliensCount * sizeof(t_alienData));
+    state->timerPool = (t_timer *)malloc((aliensCount + EXTRA_TIMERS) * sizeof(t_timer));
+    state->bullets = (t_bulletData *)malloc(g_options.maxBullets * sizeof(t_bulletData));
+    state->bulletOrder = (t_bulletKey *)malloc(g_options.maxBullets * sizeof(t_bulletKey));
+    state->shotBullets = (t_u32 *)malloc(g_options.maxBullets * sizeof(t_u32));
+
+    if (state->aliens == NULL || state->timerPool == NULL || state->bullets == NULL ||
+        state->bulletOrder == NULL || state->shotBullets == NULL)
+    {
+        printf("Unable to allocate world state\n");
+        closeWorldState(state);
+        return false;
+    }
+
+    return true;
+}
+
+void closeWorldState(t_worldState *state)
+{
+    free(state->aliens);
+    free(state->timerPool);
+    free(state->bullets);
+    free(state->bulletOrder);
+    free(state->shotBullets);
+    state->aliens = NULL;
+    state->timerPool = NULL;
+    state->bullets = NULL;
+    state->bulletOrder = NULL;
+    state->shotBullets = NULL;
+}
+
+inline t_alienData *getAlien(t_u16 col, t_u16 row)
+{
+    return &g_aliens[row * g_options.formationCols + col];
+}
+
+// left edge of formation column and top of formation row in the world,
+// cell size is constant, so multiplication is folded into shifts and adds
+inline t_i32 formationX(const t_aliensData *aliensData, t_u16 col)
+{
+    return ALIENS_PADDING_LEFT + aliensData->position.x + col * ALIEN_CELL_W;
+}
+
+inline t_i32 formationY(const t_aliensData *aliensData, t_u16 row)
+{
+    return ALIENS_PADDING_TOP + aliensData->position.y + row * ALIEN_CELL_H;
+}
+
+inline t_i32 floorDiv(t_i32 a, t_i32 b)
+{
+    // rounds towards negative infinity, unlike plain division
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void resetTimers()
+{
+    t_i32 i, count = g_options.formationRows * g_options.formationCols + EXTRA_TIMERS;
+    t_u8 level, slot;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+            g_timers.slots[level][slot] = -1;
+
+    // chain all timers into free list
+    for (i = 0; i < count; i++)
+        g_timerPool[i].next = i + 1 < count ? i + 1 : -1;
+    g_timers.freeTimer = 0;
+
+    g_timers.tick = g_game.ticks;
+}
+
+void addTimer(t_u8 kind, t_u32 delay, t_u16 col, t_u16 row)
+{
+    t_i32 id = g_timers.freeTimer;
+
+    // there is a timer for each thing that can expire, so this shouldn't happen
+    if (id < 0)
+    {
+        printf("Timer wheel is full!\n");
+        return;
+    }
+
+    g_timers.freeTimer = g_timerPool[id].next;
+
+    // timer fires at the start of the tick it expires on
+    g_timerPool[id].expires = g_game.ticks + delay;
+    g_timerPool[id].kind = kind;
+    g_timerPool[id].col = col;
+    g_timerPool[id].row = row;
+
+    insertTimer(id);
+}
+
+void insertTimer(t_i32 id)
+{
+    t_timer *timer = &g_timerPool[id];
+    t_u32 delta = timer->expires - g_timers.tick;
+    t_i32 *slot;
+
+    if (delta < TIMER_WHEEL_SLOTS)
+    {
+        slot = &g_timers.slots[0][timer->expires % TIMER_WHEEL_SLOTS];
+    }
+    else
+    {
+        // timers further than the second level can reach wait in its
+        // farthest slot and are reinserted when it is moved down
+        t_u32 block = delta < TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS
+            ? timer->expires >> TIMER_WHEEL_BITS
+            : g_timers.tick >> TIMER_WHEEL_BITS;
+
+        slot = &g_timers.slots[1][block % TIMER_WHEEL_SLOTS];
+    }
+
+    timer->next = *slot;
+    *slot = id;
+}
+
+void updateTimers()
+{
+    while (g_timers.tick <= g_game.ticks)
+    {
+        t_i32 id;
+
+        // move timers of the next block down to the first level
+        if (g_timers.tick % TIMER_WHEEL_SLOTS == 0)
+        {
+            t_i32 *block = &g_timers.slots[1][(g_timers.tick >> TIMER_WHEEL_BITS) % TIMER_WHEEL_SLOTS];
+
+            id = *block;
+            *block = -1;
+
+            while (id >= 0)
+            {
+                t_i32 next = g_timerPool[id].next;
+                insertTimer(id);
+                id = next;
+            }
+        }
+
+        // head is reread every time, as firing can add timers or reset the wheel
+        t_i32 *slot = &g_timers.slots[0][g_timers.tick % TIMER_WHEEL_SLOTS];
+        while ((id = *slot) >= 0)
+        {
+            t_timer timer = g_timerPool[id];
+
+            *slot = timer.next;
+            g_timerPool[id].next = g_timers.freeTimer;
+            g_timers.freeTimer = id;
+
+            fireTimer(&timer);
+        }
+
+        g_timers.tick++;
+    }
+}
+
+void fireTimer(const t_timer *timer)
+{
+    switch (timer->kind)
+    {
+        case TIMER_ALIEN_EXPLOSION:
+            getAlien(timer->col, timer->row)->isHidden = true;
+            g_aliensData.hiddenCount++;
+            g_aliensData.hasHidden = true;
+            break;
+        case TIMER_UFO_EXPLOSION:
+            hideUfo();
+            break;
+        case TIMER_PLAYER_INVINCIBLE:
+            g_playerData.isInvincible = false;
+            break;
+        case TIMER_PLAYER_RESTART:
+            startGame();
+            break;
+        case TIMER_SHOOT_COOLDOWN:
+            g_playerData.isReloading = false;
+            break;
+    }
+}
+
+void saveWorld(t_worldState *state)
+{
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+
+    state->game = g_game;
+    state->playerData = g_playerData;
+    state->aliensData = g_aliensData;
+    memcpy(state->aliens, g_aliens, aliensCount * sizeof(t_alienData));
+    memcpy(state->shields, g_shields, sizeof(g_shields));
+    state->ufoData = g_ufoData;
+    state->timers = g_timers;
+    memcpy(state->timerPool, g_timerPool, (aliensCount + EXTRA_TIMERS) * sizeof(t_timer));
+
+    // bullets after the last one are all free
+    memcpy(state->bullets, g_bullets, g_game.lastBullet * sizeof(t_bulletData));
+    memcpy(state->bulletOrder, g_bulletOrder, g_game.sortedBullets * sizeof(t_bulletKey));
+    memcpy(state->shotBullets, g_shotBullets, g_game.shotBullets * sizeof(t_u32));
+}
+
+void loadWorld(const t_worldState *state)
+{
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+    t_u32 i;
+
+    // free bullets that loaded world doesn't have
+    for (i = state->game.lastBullet; i < g_game.lastBullet; i++)
+        g_bullets[i].isVisible = false;
+
+    g_game = state->game;
+    g_playerData = state->playerData;
+    g_aliensData = state->aliensData;
+    memcpy(g_aliens, state->aliens, aliensCount * sizeof(t_alienData));
+    memcpy(g_shields, state->shields, sizeof(g_shields));
+    g_ufoData = state->ufoData;
+    g_timers = state->timers;
+    memcpy(g_timerPool, state->timerPool, (aliensCount + EXTRA_TIMERS) * sizeof(t_timer));
+    memcpy(g_bullets, state->bullets, g_game.lastBullet * sizeof(t_bulletData));
+    memcpy(g_bulletOrder, state->bulletOrder, g_game.sortedBullets * sizeof(t_bulletKey));
+    memcpy(g_shotBullets, state->shotBullets, g_game.shotBullets * sizeof(t_u32));
+
+    // shields texture doesn't match loaded shields anymore
+    for (i = 0; i < SHIELDS_COUNT; i++)
+        markShieldDirty(&g_shields[i], 0, 0, SHIELD_W, SHIELD_H);
+}
+
+t_u32 nextRandom(t_u32 *state)
+{
+    // xorshift32, state must never be zero
+    t_u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+void playSound(Mix_Chunk *chunk)
+{
+    if (!g_isMuted)
+        Mix_PlayChannel(-1, chunk, 0);
+}
+
+void shoot(e_entites entity, t_u16 col, t_u16 row)
+{
+    t_u32 i;
 
     // finding first avaible empty space in bullets array
-    for (i = 0; i < MAX_BULLETS; i++)
-        if (g_bullets[i] == NULL)
+    for (i = g_game.freeBullet; i < g_options.maxBullets; i++)
+        if (!g_bullets[i].isVisible)
         {
-            g_bullets[i] = (t_bulletData *)malloc(sizeof(t_bulletData));
-            g_bullets[i]->entity = entity;
-            g_bullets[i]->isVisible = true;
+            g_bullets[i].entity = entity;
+            g_bullets[i].isVisible = true;
+            g_bullets[i].isSorted = false;
+            g_shotBullets[g_game.shotBullets++] = i;
+            g_game.visibleBullets++;
 
             if (entity == PLAYER_ENTITY)
             {
                 // placing bullet a bit above current player position
-                g_bullets[i]->position.x = 
-                    g_playerData.position.x + g_renderRects[PLAYER_ENTITY].w / 2 - BULLET_W / 2;
+                g_bullets[i].position.x = 
+                    g_playerData.position.x + PLAYER_W / 2 - BULLET_W / 2;
 
-                g_bullets[i]->position.y = 
-                    SCREEN_H - g_renderRects[PLAYER_ENTITY].h - g_renderRects[BULLET_ENTITY].h - 15;
+                g_bullets[i].position.y = 
+                    g_world.h - PLAYER_H - BULLET_H - 15;
             }
             else if (entity == ALIEN_ENTITY)
             {
                 // placing bullet a bit below provided alien position
-                g_bullets[i]->position.x = 
-                    ALIENS_PADDING_LEFT + g_aliensData.position.x +
-                    col * (g_renderRects[ALIEN_ENTITY].w + ALIENS_ROW_SPACING) +
-                    g_renderRects[ALIEN_ENTITY].w / 2;
-
-                g_bullets[i]->position.y = 
-                    ALIENS_PADDING_TOP + g_aliensData.position.y +
-                    row * (g_renderRects[ALIEN_ENTITY].h + ALIENS_COL_SPACING) + 
-                    g_renderRects[ALIEN_ENTITY].h + 10;
+                g_bullets[i].position.x = formationX(&g_aliensData, col) + ALIEN_W / 2;
+                g_bullets[i].position.y = formationY(&g_aliensData, row) + ALIEN_H + 10;
             }
 
             break;       
         }
 
+    // nothing before found bullet is free (all bullets are in use when nothing was found)
+    g_game.freeBullet = i;
+
     // updating last bullet index if reached last index
-    if (i == g_game.lastBullet)
-        g_game.lastBullet++;
+    if (i >= g_game.lastBullet && i < g_options.maxBullets)
+        g_game.lastBullet = i + 1;
 
     if (entity == PLAYER_ENTITY)
-        Mix_PlayChannel(-1, g_audioData.playerShot, 0); 
+        playSound(g_audioData.playerShot);
 }
 
-void killAlien(t_u8 col, t_u8 row)
+void killAlien(t_u16 col, t_u16 row)
 {
-    if (g_aliens[row][col].deathTime == 0)
+    t_alienData *alien = getAlien(col, row);
+
+    if (alien->deathTime == 0)
     {
-        g_aliens[row][col].deathTime = g_game.ticks;
-        Mix_PlayChannel(-1, g_audioData.alienExplosion, 0); 
+        alien->deathTime = g_game.ticks;
+        g_aliensData.aliveCount--;
+        // hide once explosion animation is over
+        addTimer(TIMER_ALIEN_EXPLOSION, ALIEN_EXPLOSION_TIME + 1, col, row);
+        // upper kinds are worth more
+        g_game.score += (ALIENS_COUNT - alien->entity) * ALIEN_SCORE_STEP;
+        playSound(g_audioData.alienExplosion);
     }
 }
 
@@ -539,14 +2017,48 @@ void hitPlayer()
     {
         g_playerData.lifes--;
         g_playerData.lastHit = g_game.ticks;
+        g_playerData.isInvincible = true;
+        addTimer(TIMER_PLAYER_INVINCIBLE, PLAYER_INVINCIBLE_TIME + 1, 0, 0);
+
+        // if player is dead wait some time until explosion animation
+        // will finish and restart the game
+        if (g_playerData.lifes == 0)
+        {
+            g_playerData.deathTime = g_game.ticks;
+            g_playerData.movement = NOT_MOVING;
+            addTimer(TIMER_PLAYER_RESTART, PLAYER_EXPLOSION_TIME + 1, 0, 0);
+
+            playSound(g_audioData.playerExplosion);
+        }
     }
 }
 
 void update()
 {
+    // fire timers due on this tick before anything else is updated
+    perfBegin(PERF_UPDATE_TIMERS);
+    updateTimers();
+    perfEnd(PERF_UPDATE_TIMERS);
+
+    perfBegin(PERF_UPDATE_PLAYER);
     updatePlayer();
+    perfEnd(PERF_UPDATE_PLAYER);
+
+    perfBegin(PERF_UPDATE_ALIENS);
     updateAliens();
+    perfEnd(PERF_UPDATE_ALIENS);
+
+    perfBegin(PERF_UPDATE_BULLETS);
     updateBullets();
+    perfEnd(PERF_UPDATE_BULLETS);
+
+    perfBegin(PERF_COLLIDE_BULLETS);
+    collideBullets();
+    perfEnd(PERF_COLLIDE_BULLETS);
+
+    perfBegin(PERF_UPDATE_UFO);
+    updateUfo();
+    perfEnd(PERF_UPDATE_UFO);
 
     g_game.ticks++;
 }
@@ -559,42 +2071,23 @@ void updatePlayer()
         g_playerData.position.x -= PLAYER_SPEED;
     }
     else if (g_playerData.movement == MOVING_RIGHT 
-             && g_playerData.position.x + g_renderRects[PLAYER_ENTITY].w < SCREEN_W)
+             && g_playerData.position.x + PLAYER_W < g_world.w)
     {
         g_playerData.position.x += PLAYER_SPEED;
     }
 
     // update player shooting
-    if (g_playerData.isShooting)
-    {
-        if (g_playerData.lastShot == 0 ||
-            g_game.ticks - g_playerData.lastShot > PLAYER_SHOOT_DELAY)
-        {
-            shoot(PLAYER_ENTITY, 0, 0); 
-            g_playerData.lastShot = g_game.ticks;
-        }
-    }
-
-    // check if player is alive
-    if (g_playerData.lifes == 0 && g_playerData.deathTime == 0)
-    {
-        g_playerData.deathTime = g_game.ticks;
-        g_playerData.movement = NOT_MOVING;
-        
-        Mix_PlayChannel(-1, g_audioData.playerExplosion, 0); 
-    }
-    // if player is dead wait some time until explosion animation will finish
-    // and restart the game
-    else if (g_playerData.deathTime > 0 &&
-             g_game.ticks - g_playerData.deathTime > PLAYER_EXPLOSION_TIME)
+    if (g_playerData.isShooting && !g_playerData.isReloading)
     {
-        startGame();
+        shoot(PLAYER_ENTITY, 0, 0); 
+        g_playerData.isReloading = true;
+        addTimer(TIMER_SHOOT_COOLDOWN, PLAYER_SHOOT_DELAY + 1, 0, 0);
     }
 }
 
 void updateAliens()
 {
-    t_u8 col, row;
+    t_u16 col, row;
     
     // update movement
     if (g_game.ticks % (40 * 1 / g_aliensData.speed) == 0)
@@ -608,15 +2101,18 @@ void updateAliens()
             g_aliensData.position.x -= ALIENS_MOVE_STEP;
         }
 
+        // march beat is kept in sync with steps by audio timeline
+        scheduleSound(TIMELINE_MARCH);
+
         // check if reached horizontal boundary
         if (ALIENS_PADDING_LEFT + g_aliensData.position.x + g_aliensData.rightEdge >=
-            SCREEN_W - ALIENS_PADDING_LEFT)
+            g_world.w - ALIENS_PADDING_LEFT)
         {
             // change direction
             g_aliensData.moving = MOVING_LEFT;
 
             // descend if there is enough space
-            if (g_aliensData.position.y + g_aliensData.bottomEdge < SCREEN_H - 100)
+            if (g_aliensData.position.y + g_aliensData.bottomEdge < g_world.h - 100)
                 g_aliensData.position.y += ALIENS_DESCEND_STEP;
         }
         else if (g_aliensData.position.x <= g_aliensData.leftEdge)
@@ -625,69 +2121,74 @@ void updateAliens()
             g_aliensData.moving = MOVING_RIGHT;
 
             // descend if there is enough space
-            if (g_aliensData.position.y + g_aliensData.bottomEdge < SCREEN_H - 100)
+            if (g_aliensData.position.y + g_aliensData.bottomEdge < g_world.h - 100)
                 g_aliensData.position.y += ALIENS_DESCEND_STEP;
         }
     }
 
-    // generate shot by random alien
-    if (g_game.ticks % 40 == 0)
+    // generate shots by random aliens, bigger formations shoot
+    // one bullet per default formation size, so that fire stays as dense
+    if (g_game.ticks % 40 == 0 && g_aliensData.aliveCount > 0)
     {
-        col = rand() % ALIENS_IN_ROW;
-        row = rand() % ALIENS_COUNT;
+        t_u32 shots = (g_aliensData.aliveCount + ALIENS_COUNT * ALIENS_IN_ROW - 1) / 
+            (ALIENS_COUNT * ALIENS_IN_ROW);
 
-        // get random alien that is alive
-        while (g_aliens[row][col].deathTime > 0)
+        while (shots-- > 0)
         {
-            col = rand() % ALIENS_IN_ROW;
-            row = rand() % ALIENS_COUNT;
-        }
-
-        shoot(ALIEN_ENTITY, col, row);
-    }
+            col = nextRandom(&g_game.rngState) % g_options.formationCols;
+            row = nextRandom(&g_game.rngState) % g_options.formationRows;
 
-    bool hasDeaths = false;
-    // hide dead aliens
-    for (row = 0; row < ALIENS_COUNT; row++)
-        for (col = 0; col < ALIENS_IN_ROW; col++)
-            if (g_aliens[row][col].deathTime > 0 &&
-                g_game.ticks - g_aliens[row][col].deathTime > ALIEN_EXPLOSION_TIME)
+            // get random alien that is alive
+            while (getAlien(col, row)->deathTime > 0)
             {
-                g_aliens[row][col].isHidden = true;
-                hasDeaths = true;
+                col = nextRandom(&g_game.rngState) % g_options.formationCols;
+                row = nextRandom(&g_game.rngState) % g_options.formationRows;
             }
 
+            shoot(ALIEN_ENTITY, col, row);
+        }
+    }
+
+    // next wave once the last explosion is over
+    if (g_aliensData.hiddenCount == (t_u32)g_options.formationRows * g_options.formationCols)
+    {
+        startWave();
+        return;
+    }
+
     // recalculate left and right edges for aliens
-    // if any aliens have died (after explosion animation)
-    if (hasDeaths)
+    // if any aliens have been hidden (after explosion animation)
+    if (g_aliensData.hasHidden)
+    {
+        perfBegin(PERF_UPDATE_ALIENS_EDGES);
         updateAliensEdges();
+        perfEnd(PERF_UPDATE_ALIENS_EDGES);
+        g_aliensData.hasHidden = false;
+    }
 }
 
 void updateAliensEdges()
 {
-    t_u8 col, row;
-    t_u16 newLeftEdge, newRightEdge, newBottomEdge;
+    // signed, as columns and rows are also counted down to zero
+    t_i32 col, row;
+    t_i32 newLeftEdge, newRightEdge, newBottomEdge;
     bool stop;
 
     // start counting from initial values (not current ones)
     newLeftEdge = 0;
 
-    newRightEdge = ALIENS_IN_ROW * 
-        (g_renderRects[ALIEN_ENTITY].w + ALIENS_COL_SPACING) -
-        ALIENS_COL_SPACING;
+    newRightEdge = g_options.formationCols * ALIEN_CELL_W - ALIENS_COL_SPACING;
 
-    newBottomEdge = ALIENS_COUNT *
-        (g_renderRects[ALIEN_ENTITY].h + ALIENS_ROW_SPACING) -
-        ALIENS_ROW_SPACING;
+    newBottomEdge = g_options.formationRows * ALIEN_CELL_H - ALIENS_ROW_SPACING;
 
     // count left edge
     stop = false;
-    for (col = 0; col < ALIENS_IN_ROW && !stop; col++)
+    for (col = 0; col < g_options.formationCols && !stop; col++)
     {
-        for (row = 0; row < ALIENS_COUNT; row++)
+        for (row = 0; row < g_options.formationRows; row++)
         {
             // stop counting if current row contains alive alien
-            if (!g_aliens[row][col].isHidden)
+            if (!getAlien(col, row)->isHidden)
             {
                 stop = true;
                 break;
@@ -698,17 +2199,17 @@ void updateAliensEdges()
         {
             // reduce left edge further by one column width if whole column is dead aliens   
             // (dead means explosion animation has over from them)
-            newLeftEdge -= (g_renderRects[ALIEN_ENTITY].w + ALIENS_COL_SPACING);
+            newLeftEdge -= ALIEN_CELL_W;
         }
     }
 
     // count right edge
     stop = false;
-    for (col = ALIENS_IN_ROW - 1; col >= 0 && !stop; col--)
+    for (col = g_options.formationCols - 1; col >= 0 && !stop; col--)
     {
-        for (row = ALIENS_COUNT - 1; row >= 0; row--)
+        for (row = g_options.formationRows - 1; row >= 0; row--)
         {
-            if (!g_aliens[row][col].isHidden)
+            if (!getAlien(col, row)->isHidden)
             {
                 stop = true;
                 break;
@@ -718,17 +2219,17 @@ void updateAliensEdges()
         if (!stop)
         {
             // move right edge further by one column width if whole column is dead aliens   
-            newRightEdge += g_renderRects[ALIEN_ENTITY].w + ALIENS_COL_SPACING;
+            newRightEdge += ALIEN_CELL_W;
         }
     }
 
     // count bottom edge
     stop = false;
-    for (row = ALIENS_COUNT - 1; row >= 0; row--)
+    for (row = g_options.formationRows - 1; row >= 0; row--)
     {
-        for (col = ALIENS_IN_ROW - 1; col >= 0 && !stop; col--)
+        for (col = g_options.formationCols - 1; col >= 0 && !stop; col--)
         {
-            if (!g_aliens[row][col].isHidden)
+            if (!getAlien(col, row)->isHidden)
             {
                 stop = true;
                 break;
@@ -738,12 +2239,12 @@ void updateAliensEdges()
         if (!stop)
         {
             // reduce bottom edge by one row width if whole row is dead aliens   
-            newBottomEdge -= (g_renderRects[ALIEN_ENTITY].h + ALIENS_ROW_SPACING);
+            newBottomEdge -= ALIEN_CELL_H;
         }
     }
 
     // update values only if counted values differ from current ones
-    if (newLeftEdge > g_aliensData.leftEdge)
+    if (newLeftEdge < g_aliensData.leftEdge)
     {
         g_aliensData.leftEdge = newLeftEdge;
     }
@@ -759,133 +2260,440 @@ void updateAliensEdges()
 
 void updateBullets()
 {
-    t_u8 i;
+    t_u32 i;
 
     for (i = 0; i < g_game.lastBullet; i++)
-        if (g_bullets[i] != NULL)
+    {
+        t_bulletData *bullet = &g_bullets[i];
+
+        if (bullet->isVisible)
         {
-            if (g_bullets[i]->isVisible)
+            // mark bullets that are not visible anymore
+            if (bullet->position.y < BULLET_H * -2 ||
+                bullet->position.y > g_world.h + BULLET_H * 2)
             {
-                // mark bullets that are not visible anymore
-                if (g_bullets[i]->position.y < g_renderRects[BULLET_ENTITY].h * -2 ||
-                    g_bullets[i]->position.y > SCREEN_H + g_renderRects[BULLET_ENTITY].h * 2)
-                {
-                    g_bullets[i]->isVisible = false;
-                }
-                else if (g_bullets[i]->entity == PLAYER_ENTITY)
-                {
-                    g_bullets[i]->position.y -= BULLET_SPEED;
-                }
-                else if (g_bullets[i]->entity == ALIEN_ENTITY)
-                {
-                    g_bullets[i]->position.y += BULLET_SPEED;
-                }
+                bullet->isVisible = false;
+            }
+            else if (bullet->entity == PLAYER_ENTITY)
+            {
+                bullet->position.y -= BULLET_SPEED;
+            }
+            else if (bullet->entity == ALIEN_ENTITY)
+            {
+                bullet->position.y += BULLET_SPEED;
+            }
 
-                // check player bullets collision with aliens
-                if (g_bullets[i]->entity == PLAYER_ENTITY)
-                {
-                    t_u8 col, row; 
-                    t_u16 alienX, alienY, alienRightEdge, alienBottomEdge;
+            // shields stop bullets of both sides
+            if (bullet->isVisible && hitShields(bullet))
+                bullet->isVisible = false;
 
-                    for (row = 0; row < ALIENS_COUNT; row++)
-                        for (col = 0; col < ALIENS_IN_ROW; col++)
+            // check player bullets collision with aliens
+            if (bullet->entity == PLAYER_ENTITY && bullet->isVisible)
+            {
+                t_i32 originX = formationX(&g_aliensData, 0);
+                t_i32 originY = formationY(&g_aliensData, 0);
+                t_i32 col, row; 
+
+                // formation is a grid, so only aliens of cells bullet box overlaps
+                // can be hit, that's at most two columns by two rows of them
+                t_i32 firstCol = SDL_max(floorDiv(bullet->position.x - originX - ALIEN_W, ALIEN_CELL_W) + 1, 0);
+                t_i32 lastCol = SDL_min(floorDiv(bullet->position.x + BULLET_W - 1 - originX, ALIEN_CELL_W), g_options.formationCols - 1);
+                t_i32 firstRow = SDL_max(floorDiv(bullet->position.y - originY - ALIEN_H, ALIEN_CELL_H) + 1, 0);
+                t_i32 lastRow = SDL_min(floorDiv(bullet->position.y + BULLET_H - 1 - originY, ALIEN_CELL_H), g_options.formationRows - 1);
+
+                for (row = firstRow; row <= lastRow && bullet->isVisible; row++)
+                    for (col = firstCol; col <= lastCol && bullet->isVisible; col++)
+                    {
+                        t_alienData *alien = getAlien(col, row);
+
+                        if (alien->deathTime == 0)
                         {
-                            if (g_aliens[row][col].deathTime == 0)
+                            // getting an absolute x position in pixels
+                            // that consists of padding-left value, whole group x-offset
+                            // and total width (including spacing) of all aliens on the left
+                            t_i32 alienX = originX + col * ALIEN_CELL_W;
+
+                            // getting an absolute y position in pixels
+                            // that consists of padding-top value, whole group y-offset
+                            // and total height (including spacing) of all aliens above
+                            t_i32 alienY = originY + row * ALIEN_CELL_H;
+
+                            // pixel accurate check against currently shown animation frame
+                            if (masksOverlap(
+                                    &g_alienMasks[alien->entity][g_game.ticks / 40 % 2],
+                                    alienX, alienY,
+                                    &g_bulletMask,
+                                    bullet->position.x, bullet->position.y))
                             {
-                                // getting an absolute x position in pixels
-                                // that consists of padding-left value, whole group x-offset
-                                // and total width (including spacing) of all aliens on the left
-                                alienX = ALIENS_PADDING_LEFT + g_aliensData.position.x + 
-                                    col * (g_renderRects[ALIEN_ENTITY].w + ALIENS_COL_SPACING);
-
-                                // getting an absolute y position in pixels
-                                // that consists of padding-top value, whole group y-offset
-                                // and total height (including spacing) of all aliens above
-                                alienY = ALIENS_PADDING_TOP + g_aliensData.position.y +
-                                    row * (g_renderRects[ALIEN_ENTITY].h + ALIENS_ROW_SPACING);
-
-                                // getting right and bottom edges
-                                alienRightEdge = alienX + g_renderRects[ALIEN_ENTITY].w;
-                                alienBottomEdge = alienY + g_renderRects[ALIEN_ENTITY].h;
-
-                                // simple collision check:
-                                // taking horizontal center of bullet as x-collision point
-                                // and top edge (position.y) as y-collision point
-                                if (g_bullets[i]->position.x + g_renderRects[BULLET_ENTITY].w / 2 > alienX &&
-                                    g_bullets[i]->position.x + g_renderRects[BULLET_ENTITY].w / 2 < alienRightEdge &&
-                                    g_bullets[i]->position.y > alienY &&
-                                    g_bullets[i]->position.y < alienBottomEdge)
-                                {
-                                    killAlien(col, row);
-                                    g_bullets[i]->isVisible = false;
-                                }
+                                killAlien(col, row);
+                                bullet->isVisible = false;
                             }
                         }
-                }
-                // check aliens' bullets collision with player
-                if (g_bullets[i]->entity == ALIEN_ENTITY)
-                {
-                    t_u16 playerRightEdge = g_playerData.position.x + g_renderRects[PLAYER_ENTITY].w;
+                    }
+            }
+            // check player bullets collision with ufo
+            if (bullet->entity == PLAYER_ENTITY && bullet->isVisible &&
+                g_ufoData.isActive && g_ufoData.deathTime == 0 &&
+                masksOverlap(&g_ufoMask, g_ufoData.x, UFO_Y,
+                    &g_bulletMask, bullet->position.x, bullet->position.y))
+            {
+                g_ufoData.deathTime = g_game.ticks;
+                addTimer(TIMER_UFO_EXPLOSION, ALIEN_EXPLOSION_TIME + 1, 0, 0);
+                g_game.score += (1 + nextRandom(&g_game.rngState) % 6) * UFO_SCORE_STEP;
+                bullet->isVisible = false;
 
-                    if (g_bullets[i]->position.x + g_renderRects[BULLET_ENTITY].w / 2 > g_playerData.position.x &&
-                        g_bullets[i]->position.x + g_renderRects[BULLET_ENTITY].w / 2 < playerRightEdge &&
-                        g_bullets[i]->position.y + g_renderRects[BULLET_ENTITY].h > g_playerData.position.y)
+                scheduleSound(TIMELINE_UFO_STOP);
+                playSound(g_audioData.alienExplosion);
+            }
+
+            // check aliens' bullets collision with player
+            if (bullet->entity == ALIEN_ENTITY && bullet->isVisible)
+            {
+                if (masksOverlap(
+                        &g_playerMask,
+                        g_playerData.position.x, g_playerData.position.y,
+                        &g_bulletMask,
+                        bullet->position.x, bullet->position.y))
+                {
+                    // hit if player is not dead or invincible
+                    if (g_playerData.deathTime == 0 && !g_playerData.isInvincible)
                     {
-                        // hit if player is not dead or invincible
-                        if (g_playerData.deathTime == 0 &&
-                               (g_playerData.lastHit == 0 ||
-                                g_game.ticks - g_playerData.lastHit > PLAYER_INVINCIBLE_TIME))
-                        {
-                            hitPlayer();
-                            g_bullets[i]->isVisible = false;
-                        }
+                        hitPlayer();
+                        bullet->isVisible = false;
                     }
                 }
             }
-            else
-            {
-                // free invisible bullets'
-                free(g_bullets[i]);
-                g_bullets[i] = NULL;
-            }
+
+            // bullet went out of play by any of the ways above
+            if (!bullet->isVisible)
+                g_game.visibleBullets--;
         }
+
+        // invisible bullet slot is free to be shot again,
+        // whether it was free already or got freed just now
+        if (!bullet->isVisible && i < g_game.freeBullet)
+            g_game.freeBullet = i;
+    }
+
+    // drop free bullets from the end, so that loops over bullets stay short
+    while (g_game.lastBullet > 0 && !g_bullets[g_game.lastBullet - 1].isVisible)
+        g_game.lastBullet--;
+
+    g_game.freeBullet = SDL_min(g_game.freeBullet, g_game.lastBullet);
 }
 
-void render()
+// bullets move only vertically, so order by x of the previous tick is
+// still sorted: dead bullets are dropped from it, and newly shot ones
+// are sorted on their own and merged in.
+// shot bullets are listed by shoot(), so slots are not searched for them
+void sortBullets()
 {
-    SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0x00, 0x00, 0x00, 0xFF);
-    SDL_RenderClear(g_SDLData.pRenderer);
+    t_bulletKey *newOrder = &g_bulletOrder[g_options.maxBullets];
+    t_u32 i, count = 0, newCount = 0;
 
-    renderPlayer();
-    renderLifeBar();
-    renderAliens();
+    // shooting clears isSorted, so key of a reused slot is dropped too
+    for (i = 0; i < g_game.sortedBullets; i++)
+    {
+        const t_bulletData *bullet = &g_bullets[g_bulletOrder[i].bullet];
+
+        if (bullet->isVisible && bullet->isSorted)
+        {
+            g_bulletOrder[count] = g_bulletOrder[i];
+            g_bulletOrder[count++].y = bullet->position.y;
+        }
+    }
+
+    // shot bullet could be gone already, or be listed again
+    // after it was freed and its slot was shot once more
+    for (i = 0; i < g_game.shotBullets; i++)
+    {
+        t_u32 slot = g_shotBullets[i];
+        t_bulletData *bullet = &g_bullets[slot];
+
+        if (bullet->isVisible && !bullet->isSorted)
+        {
+            bullet->isSorted = true;
+            newOrder[newCount].x = bullet->position.x;
+            newOrder[newCount].y = bullet->position.y;
+            newOrder[newCount].bullet = slot;
+            newOrder[newCount++].entity = bullet->entity;
+        }
+    }
+
+    g_game.shotBullets = 0;
+
+    if (newCount > 1)
+        qsort(newOrder, newCount, sizeof(t_bulletKey), compareBulletKeys);
+
+    // merging from the end moves every sorted bullet at most once
+    t_u32 sorted = count, shot = newCount, to = count + newCount;
+
+    while (shot > 0)
+    {
+        if (sorted > 0 && compareBulletKeys(&g_bulletOrder[sorted - 1], &newOrder[shot - 1]) > 0)
+            g_bulletOrder[--to] = g_bulletOrder[--sorted];
+        else
+            g_bulletOrder[--to] = newOrder[--shot];
+    }
+
+    g_game.sortedBullets = count + newCount;
+}
+
+int compareBulletKeys(const void *a, const void *b)
+{
+    const t_bulletKey *x = (const t_bulletKey *)a, *y = (const t_bulletKey *)b;
+
+    // ties are broken by slot, so that order is the same in every world copy
+    if (x->x != y->x)
+        return (x->x > y->x) - (x->x < y->x);
+
+    return (x->bullet > y->bullet) - (x->bullet < y->bullet);
+}
+
+// player and aliens' bullets cancel each other on contact.
+// bullets are split by entity into horizontal bands, keeping order by x,
+// so every player's bullet is swept by x only against aliens' bullets
+// of the two bands it can meet
+void collideBullets()
+{
+    t_bulletKey *banded = &g_bulletOrder[g_options.maxBullets];
+    t_u32 *lists = g_bulletLists;
+    t_u32 listsCount = g_world.bulletBands * 2 + 2;
+    t_u32 i, j, list, band;
+    // bullets close in by two steps every tick, so they met if their
+    // boxes overlapped anywhere along the way, not only at its end
+    t_i32 nearest = -BULLET_H, farthest = BULLET_H + 2 * BULLET_SPEED;
+
+    sortBullets();
+
+    // counting sort is stable, so every list stays in order by x.
+    // once it is done, list spans from lists[list] to lists[list + 1]
+    memset(lists, 0, (listsCount + 2) * sizeof(t_u32));
+    for (i = 0; i < g_game.sortedBullets; i++)
+    {
+        g_bulletKeyLists[i] = getBulletList(&g_bulletOrder[i]);
+        lists[g_bulletKeyLists[i] + 2]++;
+    }
+    for (list = 2; list < listsCount + 2; list++)
+        lists[list] += lists[list - 1];
+    for (i = 0; i < g_game.sortedBullets; i++)
+        banded[lists[g_bulletKeyLists[i] + 1]++] = g_bulletOrder[i];
+
+    for (band = 0; band < g_world.bulletBands; band++)
+    {
+        // first aliens' bullet that isn't entirely left of the current player's one,
+        // in player's band and the one below
+        t_u32 first = lists[band * 2 + 1], last = lists[band * 2 + 2];
+        t_u32 below = lists[band * 2 + 3], belowLast = lists[band * 2 + 4];
+
+        // player's bullets with no aliens' ones around are left as they are
+        if (first == last && below == belowLast)
+            continue;
+
+        for (i = lists[band * 2]; i < lists[band * 2 + 1]; i++)
+        {
+            const t_bulletKey *key = &banded[i];
+            t_i32 left = key->x - BULLET_W, right = key->x + BULLET_W;
+
+            // cursors mostly move by a step or two per bullet, so these are
+            // taken without branching, as their count is hard to predict
+            first += (first < last) & (banded[first].x <= left);
+            first += (first < last) & (banded[first].x <= left);
+            while (first < last && banded[first].x <= left)
+                first++;
+            below += (below < belowLast) & (banded[below].x <= left);
+            below += (below < belowLast) & (banded[below].x <= left);
+            while (below < belowLast && banded[below].x <= left)
+                below++;
+
+            // bullets to the right overlap until one starts past this one's right side
+            t_u32 from[2] = { first, below }, to[2] = { last, belowLast };
+            t_u8 side;
+            bool isCanceled = false;
+
+            for (side = 0; side < 2 && !isCanceled; side++)
+                for (j = from[side]; j < to[side] && banded[j].x < right; j++)
+                {
+                    t_bulletKey *other = &banded[j];
+                    // distance from player's bullet down to aliens' one.
+                    // conditions are combined without branching, as pairs mostly fail
+                    // them at random and mispredicted branches would dominate the sweep
+                    t_i32 distance = other->y - key->y;
+
+                    if ((distance > nearest) & (distance < farthest))
+                    {
+                        g_bullets[key->bullet].isVisible = false;
+                        g_bullets[other->bullet].isVisible = false;
+                        g_game.visibleBullets -= 2;
+                        g_game.freeBullet = SDL_min(g_game.freeBullet, SDL_min(key->bullet, other->bullet));
+                        // canceled aliens' bullet is moved out of reach of the rest
+                        other->y = INT32_MIN / 2;
+                        isCanceled = true;
+                        break;
+                    }
+                }
+        }
+    }
+}
+
+// player's bullets go to band of the highest aliens' bullet they can meet,
+// aliens' bullets within BULLET_BAND_H below it are in the same band or the next one
+inline t_u32 getBulletList(const t_bulletKey *key)
+{
+    t_i32 y = key->entity == PLAYER_ENTITY ? key->y - (BULLET_H - 1) : key->y;
+    t_i32 band = floorDiv(y, BULLET_BAND_H) + 1;
+
+    band = SDL_max(SDL_min(band, (t_i32)g_world.bulletBands - 1), 0);
+
+    return band * 2 + (key->entity == PLAYER_ENTITY ? 0 : 1);
+}
+
+void updateUfo()
+{
+    // fly in from random side once in a while
+    if (!g_ufoData.isActive)
+    {
+        if (g_game.ticks >= g_ufoData.nextTime)
+        {
+            g_ufoData.isActive = true;
+            g_ufoData.deathTime = 0;
+            g_ufoData.moving = nextRandom(&g_game.rngState) % 2 ? MOVING_LEFT : MOVING_RIGHT;
+            g_ufoData.x = g_ufoData.moving == MOVING_RIGHT ? -SPRITE_CELL_W : g_world.w;
+
+            scheduleSound(TIMELINE_UFO_START);
+        }
+    }
+    // ufo explosion is finished by timer
+    else if (g_ufoData.deathTime == 0)
+    {
+        g_ufoData.x += g_ufoData.moving == MOVING_RIGHT ? UFO_SPEED : -UFO_SPEED;
+
+        if (g_ufoData.x < -SPRITE_CELL_W || g_ufoData.x > g_world.w)
+        {
+            hideUfo();
+            scheduleSound(TIMELINE_UFO_STOP);
+        }
+    }
+}
+
+void hideUfo()
+{
+    g_ufoData.isActive = false;
+    g_ufoData.deathTime = 0;
+    g_ufoData.nextTime = g_game.ticks + UFO_INTERVAL + nextRandom(&g_game.rngState) % UFO_INTERVAL;
+}
+
+void render()
+{
+    // game is always drawn at SCREEN_W x SCREEN_H,
+    // world bigger than that is scaled down to fit
+    if (g_SDLData.pRenderer != NULL)
+    {
+        SDL_SetRenderTarget(g_SDLData.pRenderer, g_SDLData.pTarget);
+        SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0x00, 0x00, 0x00, 0xFF);
+        SDL_RenderClear(g_SDLData.pRenderer);
+        SDL_RenderSetScale(g_SDLData.pRenderer, g_world.scale, g_world.scale);
+    }
+
+    perfBegin(PERF_RENDER_PLAYER);
+    renderPlayer();
+    perfEnd(PERF_RENDER_PLAYER);
+
+    perfBegin(PERF_RENDER_ALIENS);
+    renderAliens();
+    perfEnd(PERF_RENDER_ALIENS);
+
+    perfBegin(PERF_RENDER_BULLETS);
     renderBullets();
+    perfEnd(PERF_RENDER_BULLETS);
+
+    perfBegin(PERF_RENDER_UFO);
+    renderUfo();
+    perfEnd(PERF_RENDER_UFO);
+
+    perfBegin(PERF_RENDER_SHIELDS);
+    renderShields();
+    perfEnd(PERF_RENDER_SHIELDS);
+
+    // life bar and HUD are drawn over the world unscaled
+    if (g_SDLData.pRenderer != NULL)
+        SDL_RenderSetScale(g_SDLData.pRenderer, 1, 1);
+
+    perfBegin(PERF_RENDER_LIFE_BAR);
+    renderLifeBar();
+    perfEnd(PERF_RENDER_LIFE_BAR);
+
+    perfBegin(PERF_RENDER_HUD);
+    updateHud();
+    renderHud();
+    perfEnd(PERF_RENDER_HUD);
+
+    // null renderer has nothing to present
+    if (g_SDLData.pRenderer == NULL)
+        return;
 
+    if (g_replay.isPlaying)
+        renderReplayBar();
+
+    presentTarget();
+}
+
+void presentTarget()
+{
+    SDL_Rect presentRect;
+
+    SDL_SetRenderTarget(g_SDLData.pRenderer, NULL);
+    getPresentRect(&presentRect);
+
+    SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0x00, 0x00, 0x00, 0xFF);
+    SDL_RenderClear(g_SDLData.pRenderer);
+    SDL_RenderCopy(g_SDLData.pRenderer, g_SDLData.pTarget, NULL, &presentRect);
     SDL_RenderPresent(g_SDLData.pRenderer);
 }
 
+void getPresentRect(SDL_Rect *rect)
+{
+    int outputW, outputH;
+
+    // output size is in pixels, so HiDPI displays are covered too
+    SDL_GetRendererOutputSize(g_SDLData.pRenderer, &outputW, &outputH);
+
+    float scale = SDL_min((float)outputW / SCREEN_W, (float)outputH / SCREEN_H);
+    if (g_options.integerScale && scale >= 1)
+        scale = (int)scale;
+
+    // center scaled target, the rest of output stays black
+    rect->w = SCREEN_W * scale;
+    rect->h = SCREEN_H * scale;
+    rect->x = (outputW - rect->w) / 2;
+    rect->y = (outputH - rect->h) / 2;
+}
+
+void toggleFullscreen()
+{
+    g_options.fullscreen = !g_options.fullscreen;
+    SDL_SetWindowFullscreen(g_SDLData.pWindow, 
+        g_options.fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
+}
+
 void renderPlayer()
 {
-    if (g_playerData.lastHit == 0 ||
-        g_game.ticks - g_playerData.lastHit > PLAYER_INVINCIBLE_TIME ||
+    // blink while invincible
+    if (!g_playerData.isInvincible ||
         (g_game.ticks - g_playerData.lastHit) / 12 % 2 == 0)
     {
         SDL_Rect renderRect;
         
         renderRect.x = g_playerData.position.x;
         renderRect.y = g_playerData.position.y;
-        renderRect.w = g_renderRects[PLAYER_ENTITY].w;
-        renderRect.h = g_renderRects[PLAYER_ENTITY].h;
+        renderRect.w = PLAYER_W;
+        renderRect.h = PLAYER_H;
 
-        SDL_Rect *clip = g_playerData.deathTime > 0 
-            ? &g_spritesData.explosionClip[(g_game.ticks - g_playerData.deathTime) / 8 % 4]
-            : &g_spritesData.playerClip[0]; 
+        const SDL_Rect *clip = g_playerData.deathTime > 0 
+            ? &g_clips.explosions[(g_game.ticks - g_playerData.deathTime) / 8 % 4]
+            : &g_clips.player; 
 
-        SDL_RenderCopy(
-            g_SDLData.pRenderer,
-            g_spritesData.pTexture,
-            clip,
-            &renderRect);
+        renderSprite(clip, &renderRect);
     }
 }
 
@@ -897,144 +2705,2048 @@ void renderLifeBar()
     {
         SDL_Rect renderRect;
         
-        renderRect.x = 15 + (g_renderRects[PLAYER_LIFE_ENTITY].w + 10) * i;
+        renderRect.x = 15 + (PLAYER_LIFE_W + 10) * i;
         renderRect.y = 15;
-        renderRect.w = g_renderRects[PLAYER_LIFE_ENTITY].w;
-        renderRect.h = g_renderRects[PLAYER_LIFE_ENTITY].h;
+        renderRect.w = PLAYER_LIFE_W;
+        renderRect.h = PLAYER_LIFE_H;
 
-        SDL_RenderCopy(
-            g_SDLData.pRenderer,
-            g_spritesData.pTexture,
-            &g_spritesData.playerClip[0],
-            &renderRect);
+        renderSprite(&g_clips.player, &renderRect);
     }
 }
 
-void renderAlien(t_alienData *alien, t_i16 x, t_i16 y)
+void renderAlien(t_alienData *alien, t_i32 x, t_i32 y)
 {
     SDL_Rect renderRect;
     
     renderRect.x = x;
     renderRect.y = y;
-    renderRect.w = g_renderRects[ALIEN_ENTITY].w;
-    renderRect.h = g_renderRects[ALIEN_ENTITY].h;
+    renderRect.w = ALIEN_W;
+    renderRect.h = ALIEN_H;
 
-    SDL_Rect *clip = alien->deathTime > 0 
-        ? &g_spritesData.explosionClip[(g_game.ticks - alien->deathTime) / (ALIEN_EXPLOSION_TIME / 4) % 4]
-        : &g_alienClips[alien->entity][g_game.ticks / 40 % 2]; 
+    renderSprite(getAlienClip(alien, g_game.ticks), &renderRect);
+}
 
-    SDL_RenderCopy(
-        g_SDLData.pRenderer,
-        g_spritesData.pTexture,
-        clip,
-        &renderRect);
+const SDL_Rect *getAlienClip(const t_alienData *alien, t_u32 ticks)
+{
+    return alien->deathTime > 0 
+        ? &g_clips.explosions[(ticks - alien->deathTime) / (ALIEN_EXPLOSION_TIME / 4) % 4]
+        : &g_clips.aliens[alien->entity][ticks / 40 % 2]; 
 }
 
 void renderAliens()
 {
-    t_u8 row, col;
+    t_u16 row, col;
 
-    for (row = 0; row < ALIENS_COUNT; row++)
-        for (col = 0; col < ALIENS_IN_ROW; col++)
-            if (!g_aliens[row][col].isHidden)
+    for (row = 0; row < g_options.formationRows; row++)
+        for (col = 0; col < g_options.formationCols; col++)
+            if (!getAlien(col, row)->isHidden)
             {
                 renderAlien(
-                    // pointer to current alien struct
-                    &g_aliens[row][col],
-                    // x position
-                    ALIENS_PADDING_LEFT + g_aliensData.position.x +
-                        col * (g_renderRects[ALIEN_ENTITY].w + ALIENS_COL_SPACING),
-                    // y position
-                    ALIENS_PADDING_TOP + g_aliensData.position.y +
-                        row * (g_renderRects[ALIEN_ENTITY].w + ALIENS_ROW_SPACING));
+                    getAlien(col, row),
+                    formationX(&g_aliensData, col),
+                    formationY(&g_aliensData, row));
             }
 }
 
 void renderBullets()
 {
-    t_i8 i;
+    t_u32 i;
 
     for (i = 0; i < g_game.lastBullet; i++)
-        if (g_bullets[i] != NULL && g_bullets[i]->isVisible)
+        if (g_bullets[i].isVisible)
         {
             SDL_Rect renderRect;
-            renderRect.x = g_bullets[i]->position.x;
-            renderRect.y = g_bullets[i]->position.y;
+            renderRect.x = g_bullets[i].position.x;
+            renderRect.y = g_bullets[i].position.y;
             renderRect.w = BULLET_W;
             renderRect.h = BULLET_H;
 
-            SDL_RenderCopy(
-                g_SDLData.pRenderer,
-                g_spritesData.pTexture,
-                &g_spritesData.bulletClip[0],
-                &renderRect);
+            renderSprite(&g_clips.bullet, &renderRect);
         }
 }
 
-void handleEvents()
+void renderUfo()
 {
-    SDL_Event e;
+    SDL_Rect renderRect;
 
-    while (SDL_PollEvent(&e))
+    if (!g_ufoData.isActive)
+        return;
+
+    renderRect.x = g_ufoData.x;
+    renderRect.y = UFO_Y;
+    renderRect.w = UFO_W;
+    renderRect.h = UFO_H;
+
+    const SDL_Rect *clip = g_ufoData.deathTime > 0 
+        ? &g_clips.explosions[(g_game.ticks - g_ufoData.deathTime) / (ALIEN_EXPLOSION_TIME / 4) % 4]
+        : &g_clips.ufo; 
+
+    renderSprite(clip, &renderRect);
+}
+
+void renderSprite(const SDL_Rect *clip, const SDL_Rect *renderRect)
+{
+    // null renderer, only counts sprites
+    if (g_SDLData.pRenderer == NULL)
     {
-        if (e.type == SDL_QUIT)
-            g_game.isRunning = false;
-        else if (e.type = SDL_KEYDOWN)
+        g_SDLData.nullRenderCount++;
+        return;
+    }
+
+    SDL_RenderCopy(
+        g_SDLData.pRenderer,
+        g_spritesData.pTexture,
+        clip,
+        renderRect);
+}
+
+void startShields()
+{
+    t_u8 i, row;
+    t_u64 fullRow = ((t_u64)1 << SHIELD_W) - 1;
+
+    for (i = 0; i < SHIELDS_COUNT; i++)
+    {
+        for (row = 0; row < SHIELD_H; row++)
         {
-            /* nothing yet */
+            g_shields[i].rows[row] = fullRow;
+
+            // cut top corners diagonally
+            if (row < 8)
+                g_shields[i].rows[row] &= 
+                    ~(((t_u64)1 << (8 - row)) - 1) &
+                    ~((((t_u64)1 << (8 - row)) - 1) << (SHIELD_W - 8 + row));
+
+            // cut arch at the bottom middle
+            if (row >= SHIELD_H - 10)
+            {
+                t_u8 archW = row >= SHIELD_H - 8 ? 16 : 12;
+                g_shields[i].rows[row] &= ~((((t_u64)1 << archW) - 1) << (SHIELD_W - archW) / 2);
+            }
         }
+
+        markShieldDirty(&g_shields[i], 0, 0, SHIELD_W, SHIELD_H);
     }
 }
 
-void handleKeyStates()
+t_i32 shieldX(t_u8 shield)
 {
-    const Uint8 *state = SDL_GetKeyboardState(NULL);
+    // shields are centered in equal parts of the world
+    return g_world.w / SHIELDS_COUNT * shield + g_world.w / SHIELDS_COUNT / 2 - SHIELD_W / 2;
+}
 
-    // handle movement
-    if (g_playerData.deathTime == 0)
+t_u64 shiftMask(t_u64 mask, t_i16 shift)
+{
+    // negative shift moves mask to the left edge
+    if (shift >= 64 || shift <= -64)
+        return 0;
+
+    return shift >= 0 ? mask << shift : mask >> -shift;
+}
+
+bool hitShields(t_bulletData *bullet)
+{
+    t_i32 top = bullet->position.y - SHIELD_Y;
+    t_i32 bottom = top + BULLET_H;
+    t_u8 i;
+
+    // shields are all on the same rows
+    if (bottom <= 0 || top >= SHIELD_H)
+        return false;
+
+    for (i = 0; i < SHIELDS_COUNT; i++)
     {
-        if (state[SDL_SCANCODE_LEFT])
-            g_playerData.movement = MOVING_LEFT;
-        else if (state[SDL_SCANCODE_RIGHT])
-            g_playerData.movement = MOVING_RIGHT;
-        else g_playerData.movement = NOT_MOVING;
+        t_i32 x = bullet->position.x - shieldX(i);
+
+        if (x + BULLET_W <= 0 || x >= SHIELD_W)
+            continue;
+
+        t_shieldData *shield = &g_shields[i];
+        t_u64 bulletMask = shiftMask(((t_u64)1 << BULLET_W) - 1, x);
+        t_i16 row, firstRow = SDL_max(top, 0), lastRow = SDL_min(bottom, SHIELD_H) - 1;
+        t_i16 impactRow = -1;
+
+        // bullet hits the first solid row on its way
+        if (bullet->entity == PLAYER_ENTITY)
+        {
+            for (row = lastRow; row >= firstRow && impactRow == -1; row--)
+                if (shield->rows[row] & bulletMask)
+                    impactRow = row;
+        }
+        else
+        {
+            for (row = firstRow; row <= lastRow && impactRow == -1; row++)
+                if (shield->rows[row] & bulletMask)
+                    impactRow = row;
+        }
+
+        if (impactRow == -1)
+            continue;
+
+        // carve crater centered on impact point
+        t_i16 craterX = x + BULLET_W / 2 - SHIELD_CRATER_W / 2;
+        t_i16 craterY = impactRow - SHIELD_CRATER_H / 2;
+
+        for (row = 0; row < SHIELD_CRATER_H; row++)
+            if (craterY + row >= 0 && craterY + row < SHIELD_H)
+                shield->rows[craterY + row] &= ~shiftMask(g_craterMask[row], craterX);
+
+        markShieldDirty(shield, craterX, craterY, SHIELD_CRATER_W, SHIELD_CRATER_H);
+
+        return true;
     }
 
-    // handle shooting
-    if (state[SDL_SCANCODE_SPACE])
-        g_playerData.isShooting = true;
-    else g_playerData.isShooting = false;
+    return false;
 }
 
-int main()
+void markShieldDirty(t_shieldData *shield, t_i16 x, t_i16 y, t_i16 w, t_i16 h)
 {
-    SDL_Event e;
+    // clip to shield
+    t_i16 left = SDL_max(x, 0), top = SDL_max(y, 0);
+    t_i16 right = SDL_min(x + w, SHIELD_W), bottom = SDL_min(y + h, SHIELD_H);
 
-    g_SDLData.pWindow = NULL;
-    g_SDLData.pRenderer = NULL;
-    g_spritesData.pTexture = NULL;
-    g_game.isRunning = false;
+    if (left >= right || top >= bottom)
+        return;
 
-    if (initSDL())
+    // grow existing dirty area to cover new one
+    if (shield->isDirty)
     {
-        initGame();
-        startGame();
+        left = SDL_min(left, shield->dirtyRect.x);
+        top = SDL_min(top, shield->dirtyRect.y);
+        right = SDL_max(right, shield->dirtyRect.x + shield->dirtyRect.w);
+        bottom = SDL_max(bottom, shield->dirtyRect.y + shield->dirtyRect.h);
+    }
 
-        while (g_game.isRunning)
+    shield->isDirty = true;
+    shield->dirtyRect.x = left;
+    shield->dirtyRect.y = top;
+    shield->dirtyRect.w = right - left;
+    shield->dirtyRect.h = bottom - top;
+}
+
+bool initShieldsTexture()
+{
+    g_spritesData.pShieldsTexture = NULL;
+
+    // null renderer has nothing to upload to
+    if (g_SDLData.pRenderer == NULL)
+        return true;
+
+    g_spritesData.pShieldsTexture = SDL_CreateTexture(g_SDLData.pRenderer, SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STATIC, SHIELD_W * SHIELDS_COUNT, SHIELD_H);
+
+    if (g_spritesData.pShieldsTexture == NULL)
+    {
+        printf("Unable to create shields texture! SDL_Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(g_spritesData.pShieldsTexture, SDL_BLENDMODE_BLEND);
+
+    return true;
+}
+
+void updateShieldsTexture()
+{
+    static Uint32 pixels[SHIELD_W * SHIELD_H];
+    t_u8 i;
+    t_i16 row, col;
+
+    for (i = 0; i < SHIELDS_COUNT; i++)
+    {
+        t_shieldData *shield = &g_shields[i];
+        SDL_Rect *dirty = &shield->dirtyRect;
+
+        if (!shield->isDirty)
+            continue;
+
+        // expand bits of dirty area only, packed with its own pitch
+        for (row = 0; row < dirty->h; row++)
         {
-            handleEvents();
-            handleKeyStates();
-            update();
-            render();
-        }       
+            t_u64 bits = shield->rows[dirty->y + row] >> dirty->x;
+
+            for (col = 0; col < dirty->w; col++)
+                pixels[row * dirty->w + col] = (bits >> col) & 1 ? 0x20FF20FF : 0x00000000;
+        }
+
+        if (g_spritesData.pShieldsTexture != NULL)
+        {
+            SDL_Rect textureRect = *dirty;
+            textureRect.x += i * SHIELD_W;
+
+            SDL_UpdateTexture(g_spritesData.pShieldsTexture, &textureRect, 
+                pixels, dirty->w * sizeof(Uint32));
+        }
+
+        shield->isDirty = false;
     }
-    else
+}
+
+void renderShields()
+{
+    t_u8 i;
+
+    updateShieldsTexture();
+
+    for (i = 0; i < SHIELDS_COUNT; i++)
     {
-        printf("SDL init error\n");
-        exit(1);
+        SDL_Rect clip, renderRect;
+
+        clip.x = i * SHIELD_W;
+        clip.y = 0;
+        clip.w = renderRect.w = SHIELD_W;
+        clip.h = renderRect.h = SHIELD_H;
+        renderRect.x = shieldX(i);
+        renderRect.y = SHIELD_Y;
+
+        // null renderer, only counts shields
+        if (g_SDLData.pRenderer == NULL)
+        {
+            g_SDLData.nullRenderCount++;
+            continue;
+        }
+
+        SDL_RenderCopy(
+            g_SDLData.pRenderer,
+            g_spritesData.pShieldsTexture,
+            &clip,
+            &renderRect);
     }
+}
 
-    close();
+bool initHud()
+{
+    t_u8 i, row, col;
 
-    return 0;
+    // every glyph gets a cell with one pixel gap to avoid bleeding
+    t_u16 glyphCount = SDL_arraysize(g_hudFont);
+    t_u16 atlasW = glyphCount * (HUD_GLYPH_W + 1);
+
+    memset(g_hud.glyphIndex, 0, sizeof(g_hud.glyphIndex));
+    for (i = 0; i < glyphCount; i++)
+        g_hud.glyphIndex[(t_u8)g_hudGlyphs[i]] = i;
+
+    for (i = 0; i < HUD_TEXT_MAX; i++)
+    {
+        g_hud.indices[i * 6 + 0] = i * 4 + 0;
+        g_hud.indices[i * 6 + 1] = i * 4 + 1;
+        g_hud.indices[i * 6 + 2] = i * 4 + 2;
+        g_hud.indices[i * 6 + 3] = i * 4 + 2;
+        g_hud.indices[i * 6 + 4] = i * 4 + 3;
+        g_hud.indices[i * 6 + 5] = i * 4 + 0;
+    }
+
+    g_hud.scoreText.isValid = false;
+    g_hud.waveText.isValid = false;
+    g_hud.fpsText.isValid = false;
+    g_hud.replayText.isValid = false;
+    g_hud.fps = 0;
+    g_hud.frames = 0;
+    g_hud.fpsTime = SDL_GetPerformanceCounter();
+
+    // null renderer needs layout only
+    if (g_SDLData.pRenderer == NULL)
+        return true;
+
+    // bake atlas once, white glyphs on transparent background
+    Uint32 *pixels = (Uint32 *)calloc(atlasW * HUD_GLYPH_H, sizeof(Uint32));
+    if (pixels == NULL)
+        return false;
+
+    for (i = 0; i < glyphCount; i++)
+        for (row = 0; row < HUD_GLYPH_H; row++)
+            for (col = 0; col < HUD_GLYPH_W; col++)
+                if (g_hudFont[i][row] & (0x10 >> col))
+                    pixels[row * atlasW + i * (HUD_GLYPH_W + 1) + col] = 0xFFFFFFFF;
+
+    g_hud.pAtlas = SDL_CreateTexture(g_SDLData.pRenderer, SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STATIC, atlasW, HUD_GLYPH_H);
+
+    if (g_hud.pAtlas == NULL)
+    {
+        printf("Unable to create HUD atlas! SDL_Error: %s\n", SDL_GetError());
+        free(pixels);
+        return false;
+    }
+
+    SDL_UpdateTexture(g_hud.pAtlas, NULL, pixels, atlasW * sizeof(Uint32));
+    SDL_SetTextureBlendMode(g_hud.pAtlas, SDL_BLENDMODE_BLEND);
+    free(pixels);
+
+    return true;
+}
+
+void closeHud()
+{
+    if (g_hud.pAtlas != NULL)
+        SDL_DestroyTexture(g_hud.pAtlas);
+    g_hud.pAtlas = NULL;
+}
+
+void updateHud()
+{
+    // count frames rendered during last second
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    g_hud.frames++;
+    if (now - g_hud.fpsTime >= SDL_GetPerformanceFrequency())
+    {
+        g_hud.fps = g_hud.frames;
+        g_hud.frames = 0;
+        g_hud.fpsTime = now;
+    }
+
+    // runs are laid out again only if displayed value has changed
+    setTextRun(&g_hud.scoreText, SCREEN_W - 15, 15, true, "SCORE %06d", g_game.score);
+    setTextRun(&g_hud.waveText, SCREEN_W / 2 - 3 * HUD_GLYPH_W * HUD_GLYPH_SCALE, 15, false, "WAVE %d", g_game.wave);
+    setTextRun(&g_hud.fpsText, SCREEN_W - 15, 35, true, "%d FPS", g_hud.fps);
+
+    if (g_replay.isPlaying)
+        setTextRun(&g_hud.replayText, 15, SCREEN_H - REPLAY_BAR_H - 25, false, "TICK %d", g_game.ticks);
+}
+
+void renderHud()
+{
+    renderTextRun(&g_hud.scoreText);
+    renderTextRun(&g_hud.waveText);
+    renderTextRun(&g_hud.fpsText);
+
+    if (g_replay.isPlaying)
+        renderTextRun(&g_hud.replayText);
+}
+
+void setTextRun(t_textRun *run, t_i16 x, t_i16 y, bool alignRight, const char *format, t_i32 value)
+{
+    char text[HUD_TEXT_MAX + 1];
+    t_u8 i, corner;
+
+    if (run->isValid && run->value == value)
+        return;
+
+    run->value = value;
+    run->isValid = true;
+    run->length = SDL_min(snprintf(text, sizeof(text), format, value), HUD_TEXT_MAX);
+
+    t_i16 advance = (HUD_GLYPH_W + 1) * HUD_GLYPH_SCALE;
+    if (alignRight)
+        x -= run->length * advance - HUD_GLYPH_SCALE;
+
+    // atlas is a single row of glyph cells
+    float atlasW = SDL_arraysize(g_hudFont) * (HUD_GLYPH_W + 1);
+
+    for (i = 0; i < run->length; i++)
+    {
+        SDL_Vertex *quad = &run->vertices[i * 4];
+        t_u8 glyph = g_hud.glyphIndex[(t_u8)text[i] & 0x7F];
+
+        for (corner = 0; corner < 4; corner++)
+        {
+            // corners go clockwise starting from top-left
+            bool isRight = corner == 1 || corner == 2;
+            bool isBottom = corner >= 2;
+
+            quad[corner].position.x = x + i * advance + isRight * HUD_GLYPH_W * HUD_GLYPH_SCALE;
+            quad[corner].position.y = y + isBottom * HUD_GLYPH_H * HUD_GLYPH_SCALE;
+            quad[corner].tex_coord.x = (glyph * (HUD_GLYPH_W + 1) + isRight * HUD_GLYPH_W) / atlasW;
+            quad[corner].tex_coord.y = isBottom;
+            quad[corner].color.r = 0xFF;
+            quad[corner].color.g = 0xFF;
+            quad[corner].color.b = 0xFF;
+            quad[corner].color.a = 0xFF;
+        }
+    }
+}
+
+void renderTextRun(const t_textRun *run)
+{
+    // null renderer, only counts glyphs
+    if (g_SDLData.pRenderer == NULL)
+    {
+        g_SDLData.nullRenderCount += run->length;
+        return;
+    }
+
+    // whole run is submitted at once
+    SDL_RenderGeometry(
+        g_SDLData.pRenderer,
+        g_hud.pAtlas,
+        run->vertices, run->length * 4,
+        g_hud.indices, run->length * 6);
+}
+
+void handleEvents()
+{
+    SDL_Event e;
+
+    while (SDL_PollEvent(&e))
+    {
+        if (e.type == SDL_QUIT)
+            g_game.isRunning = false;
+        else if (g_replay.isPlaying && handleReplayEvent(&e))
+            continue;
+        // spectator tiles are kept in target between frames
+        else if (e.type == SDL_RENDER_TARGETS_RESET)
+            g_spectator.isRedrawAll = true;
+        else if (e.type == SDL_KEYDOWN && e.key.repeat == 0)
+        {
+            // toggle autopilot
+            if (e.key.keysym.sym == SDLK_F1 && !g_replay.isPlaying && !g_spectator.isEnabled)
+            {
+                if (g_autopilot.isEnabled)
+                    g_autopilot.isEnabled = false;
+                else if (!initAutopilot())
+                    printf("Autopilot init error\n");
+            }
+            // print hardware counters collected so far
+            else if (e.key.keysym.sym == SDLK_F2)
+            {
+                if (g_perf.isEnabled)
+                    printPerfCounters();
+                else printf("Hardware performance counters are disabled, run with --perf\n");
+            }
+            // switch between integer scale and letterbox
+            else if (e.key.keysym.sym == SDLK_F3)
+            {
+                g_options.integerScale = !g_options.integerScale;
+            }
+            else if (e.key.keysym.sym == SDLK_F11)
+            {
+                toggleFullscreen();
+            }
+        }
+    }
+}
+
+void handleKeyStates()
+{
+    const Uint8 *state = SDL_GetKeyboardState(NULL);
+
+    // handle movement
+    if (g_playerData.deathTime == 0)
+    {
+        if (state[SDL_SCANCODE_LEFT])
+            g_playerData.movement = MOVING_LEFT;
+        else if (state[SDL_SCANCODE_RIGHT])
+            g_playerData.movement = MOVING_RIGHT;
+        else g_playerData.movement = NOT_MOVING;
+    }
+
+    // handle shooting
+    if (state[SDL_SCANCODE_SPACE])
+        g_playerData.isShooting = true;
+    else g_playerData.isShooting = false;
+}
+
+bool initAutopilot()
+{
+    g_autopilot.isEnabled = initAutopilotWorkers();
+
+    return g_autopilot.isEnabled;
+}
+
+bool initAutopilotWorkers()
+{
+    t_u8 i;
+
+    // workers are kept alive after autopilot is switched off
+    if (g_autopilot.workersCount > 0)
+        return true;
+
+    g_autopilot.isQuitting = false;
+    g_autopilot.action = AUTOPILOT_IDLE;
+    g_autopilot.reportTime = SDL_GetPerformanceCounter();
+    g_autopilot.reportRollouts = 0;
+
+    if (!initWorldState(&g_autopilot.root))
+        return false;
+
+    g_autopilot.pDone = SDL_CreateSemaphore(0);
+    if (g_autopilot.pDone == NULL)
+    {
+        printf("Unable to create autopilot semaphore! SDL_Error: %s\n", SDL_GetError());
+        closeWorldState(&g_autopilot.root);
+        return false;
+    }
+
+    // one worker per core
+    t_u8 count = SDL_min(SDL_max(SDL_GetCPUCount(), 1), AUTOPILOT_MAX_THREADS);
+
+    for (i = 0; i < count; i++)
+    {
+        t_autopilotWorker *worker = &g_autopilot.workers[i];
+
+        // seeds come from a copy of world's generator, which must change
+        // only in update(), otherwise replay recorded with autopilot diverges
+        t_u32 rngState = g_game.rngState + i;
+        worker->seed = nextRandom(&rngState) | 1;
+        worker->index = i;
+        worker->pStart = SDL_CreateSemaphore(0);
+        worker->pThread = worker->pStart != NULL 
+            ? SDL_CreateThread(autopilotWorker, "autopilot", worker)
+            : NULL;
+
+        if (worker->pThread == NULL)
+        {
+            printf("Unable to create autopilot worker! SDL_Error: %s\n", SDL_GetError());
+            if (worker->pStart != NULL)
+                SDL_DestroySemaphore(worker->pStart);
+            break;
+        }
+
+        g_autopilot.workersCount++;
+    }
+
+    if (g_autopilot.workersCount == 0)
+    {
+        SDL_DestroySemaphore(g_autopilot.pDone);
+        g_autopilot.pDone = NULL;
+        closeWorldState(&g_autopilot.root);
+        return false;
+    }
+
+    printf("Started %d autopilot worker threads\n", g_autopilot.workersCount);
+
+    return true;
+}
+
+void closeAutopilot()
+{
+    t_u8 i;
+
+    if (g_autopilot.workersCount == 0)
+        return;
+
+    g_autopilot.isQuitting = true;
+    for (i = 0; i < g_autopilot.workersCount; i++)
+        SDL_SemPost(g_autopilot.workers[i].pStart);
+
+    for (i = 0; i < g_autopilot.workersCount; i++)
+    {
+        SDL_WaitThread(g_autopilot.workers[i].pThread, NULL);
+        SDL_DestroySemaphore(g_autopilot.workers[i].pStart);
+    }
+
+    SDL_DestroySemaphore(g_autopilot.pDone);
+    g_autopilot.pDone = NULL;
+    closeWorldState(&g_autopilot.root);
+    g_autopilot.workersCount = 0;
+    g_autopilot.isEnabled = false;
+}
+
+void updateAutopilot()
+{
+    t_u8 i, action;
+
+    // only make a new decision every few ticks, keep previous action between
+    if (g_playerData.deathTime == 0 && g_game.ticks % AUTOPILOT_DECISION_TICKS == 0)
+    {
+        saveWorld(&g_autopilot.root);
+        g_autopilot.deadline = SDL_GetPerformanceCounter() +
+            SDL_GetPerformanceFrequency() * AUTOPILOT_BUDGET_MS / 1000;
+
+        for (i = 0; i < g_autopilot.workersCount; i++)
+            SDL_SemPost(g_autopilot.workers[i].pStart);
+        for (i = 0; i < g_autopilot.workersCount; i++)
+            SDL_SemWait(g_autopilot.pDone);
+
+        // sum up results of all workers and pick action with best average value
+        t_i64 valueSum[AUTOPILOT_ACTION_COUNT] = { 0 };
+        t_u32 valueCount[AUTOPILOT_ACTION_COUNT] = { 0 };
+
+        for (i = 0; i < g_autopilot.workersCount; i++)
+        {
+            t_autopilotWorker *worker = &g_autopilot.workers[i];
+
+            for (action = 0; action < AUTOPILOT_ACTION_COUNT; action++)
+            {
+                valueSum[action] += worker->valueSum[action];
+                valueCount[action] += worker->valueCount[action];
+            }
+            g_autopilot.reportRollouts += worker->rollouts;
+        }
+
+        double bestValue = 0;
+        bool hasBest = false;
+        g_autopilot.action = AUTOPILOT_IDLE;
+
+        for (action = 0; action < AUTOPILOT_ACTION_COUNT; action++)
+            if (valueCount[action] > 0)
+            {
+                double value = (double)valueSum[action] / valueCount[action];
+
+                if (!hasBest || value > bestValue)
+                {
+                    hasBest = true;
+                    bestValue = value;
+                    g_autopilot.action = action;
+                }
+            }
+    }
+
+    // report performance once per second
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now - g_autopilot.reportTime >= SDL_GetPerformanceFrequency())
+    {
+        printf("Autopilot: %.0f rollouts/s\n",
+            (double)g_autopilot.reportRollouts * SDL_GetPerformanceFrequency() /
+            (now - g_autopilot.reportTime));
+
+        g_autopilot.reportTime = now;
+        g_autopilot.reportRollouts = 0;
+    }
+
+    applyAutopilotAction(g_autopilot.action);
+}
+
+void applyAutopilotAction(t_u8 action)
+{
+    if (g_playerData.deathTime == 0)
+    {
+        if (action == AUTOPILOT_LEFT)
+            g_playerData.movement = MOVING_LEFT;
+        else if (action == AUTOPILOT_RIGHT)
+            g_playerData.movement = MOVING_RIGHT;
+        else g_playerData.movement = NOT_MOVING;
+    }
+
+    g_playerData.isShooting = action == AUTOPILOT_FIRE;
+}
+
+t_i32 runRollout(t_u8 action, t_u32 *seed)
+{
+    t_u16 t;
+    t_i32 value = 0;
+
+    loadWorld(&g_autopilot.root);
+
+    // every rollout gets its own future of alien shots
+    g_game.rngState = nextRandom(seed) | 1;
+
+    t_u8 lifes = g_playerData.lifes;
+    t_u32 score = g_game.score;
+
+    for (t = 0; t < AUTOPILOT_HORIZON; t++)
+    {
+        // candidate action is held for first decision,
+        // after that player acts randomly
+        if (t > 0 && t % AUTOPILOT_DECISION_TICKS == 0)
+            action = nextRandom(seed) % AUTOPILOT_ACTION_COUNT;
+
+        applyAutopilotAction(action);
+        update();
+
+        // the sooner player is hit the worse
+        if (g_playerData.lifes < lifes)
+        {
+            value -= AUTOPILOT_HIT_PENALTY * (AUTOPILOT_HORIZON - t) / AUTOPILOT_HORIZON;
+            break;
+        }
+    }
+
+    value += (g_game.score - score) * AUTOPILOT_SCORE_REWARD;
+
+    return value;
+}
+
+int autopilotWorker(void *data)
+{
+    t_autopilotWorker *worker = (t_autopilotWorker *)data;
+    t_u8 action;
+
+    g_isMuted = true;
+
+    // worker without a world of its own only reports back
+    bool hasWorld = initWorld();
+
+    while (true)
+    {
+        SDL_SemWait(worker->pStart);
+        if (g_autopilot.isQuitting)
+            break;
+
+        // the same workers step spectated worlds instead of rolling out
+        if (g_spectator.isEnabled)
+        {
+            if (hasWorld)
+                stepSpectatorWorlds(worker->index);
+
+            SDL_SemPost(g_autopilot.pDone);
+            continue;
+        }
+
+        worker->rollouts = 0;
+        for (action = 0; action < AUTOPILOT_ACTION_COUNT; action++)
+        {
+            worker->valueSum[action] = 0;
+            worker->valueCount[action] = 0;
+        }
+
+        // cycle through candidate actions until time is over
+        action = 0;
+        while (hasWorld && SDL_GetPerformanceCounter() < g_autopilot.deadline)
+        {
+            worker->valueSum[action] += runRollout(action, &worker->seed);
+            worker->valueCount[action]++;
+            worker->rollouts++;
+
+            action = (action + 1) % AUTOPILOT_ACTION_COUNT;
+        }
+
+        SDL_SemPost(g_autopilot.pDone);
+    }
+
+    closeWorld();
+
+    return 0;
+}
+
+bool initPerfCounters()
+{
+#ifdef __linux__
+    // generic events, cache ones are encoded as (cache | op << 8 | result << 16)
+    const t_u32 types[PERF_EVENT_COUNT] =
+    {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE
+    };
+    const t_u64 configs[PERF_EVENT_COUNT] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+    t_u8 i;
+
+    g_perf.groupFd = -1;
+    g_perf.openedCount = 0;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // whole group is started at once by its leader
+        attr.disabled = g_perf.groupFd == -1;
+
+        // measure calling thread on any cpu
+        g_perf.fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, g_perf.groupFd, 0);
+        g_perf.slots[i] = -1;
+
+        if (g_perf.fds[i] == -1)
+        {
+            // cycles are group leader and are required
+            if (i == PERF_CYCLES)
+            {
+                printf("Unable to open cycles counter! Check /proc/sys/kernel/perf_event_paranoid\n");
+                return false;
+            }
+
+            printf("Hardware counter for %s is not supported, skipping\n",
+                i == PERF_L1D_MISSES ? "L1D misses" :
+                i == PERF_LLC_MISSES ? "LLC misses" :
+                i == PERF_BRANCHES ? "branches" :
+                i == PERF_BRANCH_MISSES ? "branch misses" : "instructions");
+            continue;
+        }
+
+        if (g_perf.groupFd == -1)
+            g_perf.groupFd = g_perf.fds[i];
+
+        g_perf.slots[i] = g_perf.openedCount++;
+    }
+
+    ioctl(g_perf.groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g_perf.groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    g_perf.isEnabled = true;
+    g_isPerfThread = true;
+
+    return true;
+#else
+    printf("Hardware performance counters are supported on Linux only\n");
+    return false;
+#endif
+}
+
+void closePerfCounters()
+{
+#ifdef __linux__
+    t_u8 i;
+
+    if (!g_perf.isEnabled)
+        return;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+        if (g_perf.slots[i] != -1)
+            close(g_perf.fds[i]);
+
+    g_perf.isEnabled = false;
+#endif
+}
+
+bool readPerfCounters(t_u64 *values)
+{
+#ifdef __linux__
+    // group read format: number of events followed by their values
+    t_u64 buffer[PERF_EVENT_COUNT + 1];
+    t_u8 i;
+
+    if (read(g_perf.groupFd, buffer, sizeof(buffer)) < (ssize_t)sizeof(t_u64))
+        return false;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+        values[i] = g_perf.slots[i] != -1 ? buffer[1 + g_perf.slots[i]] : 0;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void perfBegin(t_u8 subsystem)
+{
+    if (!g_perf.isEnabled || !g_isPerfThread)
+        return;
+
+    readPerfCounters(g_perf.start[subsystem]);
+}
+
+void perfEnd(t_u8 subsystem)
+{
+    t_u64 values[PERF_EVENT_COUNT];
+    t_u8 i;
+
+    if (!g_perf.isEnabled || !g_isPerfThread || !readPerfCounters(values))
+        return;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+        g_perf.total[subsystem][i] += values[i] - g_perf.start[subsystem][i];
+    g_perf.calls[subsystem]++;
+}
+
+void printPerfCounters()
+{
+    t_u8 i;
+
+    // updateAliens includes updateAliensEdges called from it
+    printf("%-18s %9s %12s %12s %6s %9s %9s %10s\n",
+        "subsystem", "calls", "cycles/call", "instr/call", "IPC",
+        "L1D MPKI", "LLC MPKI", "br miss %");
+
+    for (i = 0; i < PERF_SUBSYSTEM_COUNT; i++)
+    {
+        t_u64 *total = g_perf.total[i];
+        double calls = SDL_max(g_perf.calls[i], 1);
+        double kiloInstructions = SDL_max(total[PERF_INSTRUCTIONS], 1) / 1000.0;
+
+        printf("%-18s %9u %12.0f %12.0f %6.2f %9.2f %9.2f %10.2f\n",
+            g_perfSubsystemNames[i],
+            g_perf.calls[i],
+            total[PERF_CYCLES] / calls,
+            total[PERF_INSTRUCTIONS] / calls,
+            total[PERF_CYCLES] > 0 ? (double)total[PERF_INSTRUCTIONS] / total[PERF_CYCLES] : 0.0,
+            total[PERF_L1D_MISSES] / kiloInstructions,
+            total[PERF_LLC_MISSES] / kiloInstructions,
+            total[PERF_BRANCHES] > 0 ? 100.0 * total[PERF_BRANCH_MISSES] / total[PERF_BRANCHES] : 0.0);
+    }
+}
+
+bool initRecording(const char *path)
+{
+    t_replayHeader header;
+
+    g_replay.pFile = fopen(path, "wb");
+    if (g_replay.pFile == NULL)
+    {
+        printf("Unable to create replay file %s\n", path);
+        return false;
+    }
+
+    if (!initWorldState(&g_replay.state))
+    {
+        closeReplay();
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "SIREPLAY", sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.keyframeSize = sizeof(t_keyframe);
+    header.elementsSize = sizeof(t_alienData) + sizeof(t_timer) + sizeof(t_bulletData) + sizeof(t_bulletKey);
+    header.keyframeTicks = REPLAY_KEYFRAME_TICKS;
+    header.formationRows = g_options.formationRows;
+    header.formationCols = g_options.formationCols;
+    header.maxBullets = g_options.maxBullets;
+    fwrite(&header, sizeof(header), 1, g_replay.pFile);
+
+    g_replay.keyframeTicks = REPLAY_KEYFRAME_TICKS;
+    g_replay.firstTick = g_game.ticks;
+    g_replay.isRecording = true;
+
+    return true;
+}
+
+void recordTick()
+{
+    // keyframe is the world before this tick's input is applied
+    if ((g_game.ticks - g_replay.firstTick) % g_replay.keyframeTicks == 0)
+        writeKeyframe();
+
+    // input is recorded as player data got it, whoever was playing
+    fputc(g_playerData.movement | (g_playerData.isShooting ? REPLAY_INPUT_SHOOTING : 0), g_replay.pFile);
+
+    if (ferror(g_replay.pFile))
+    {
+        printf("Unable to write replay, recording is stopped\n");
+        g_replay.isRecording = false;
+    }
+}
+
+size_t getKeyframeSize(const t_game *game)
+{
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+
+    return sizeof(t_keyframe) +
+        alignReplay(aliensCount * sizeof(t_alienData)) +
+        alignReplay((aliensCount + EXTRA_TIMERS) * sizeof(t_timer)) +
+        alignReplay(game->lastBullet * sizeof(t_bulletData)) +
+        alignReplay(game->sortedBullets * sizeof(t_bulletKey)) +
+        alignReplay(game->shotBullets * sizeof(t_u32));
+}
+
+void writeKeyframe()
+{
+    t_worldState *state = &g_replay.state;
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+    t_keyframe keyframe;
+
+    saveWorld(state);
+
+    memset(&keyframe, 0, sizeof(keyframe));
+    keyframe.size = getKeyframeSize(&state->game);
+    keyframe.game = state->game;
+    keyframe.playerData = state->playerData;
+    keyframe.aliensData = state->aliensData;
+    keyframe.ufoData = state->ufoData;
+    memcpy(keyframe.shields, state->shields, sizeof(keyframe.shields));
+    keyframe.timers = state->timers;
+
+    // inputs before are padded, so that keyframe is aligned in mapped file
+    long position = ftell(g_replay.pFile);
+    while (position < (long)alignReplay(position))
+    {
+        fputc(0, g_replay.pFile);
+        position++;
+    }
+
+    fwrite(&keyframe, sizeof(keyframe), 1, g_replay.pFile);
+    writeReplayArray(state->aliens, aliensCount * sizeof(t_alienData));
+    writeReplayArray(state->timerPool, (aliensCount + EXTRA_TIMERS) * sizeof(t_timer));
+    writeReplayArray(state->bullets, state->game.lastBullet * sizeof(t_bulletData));
+    writeReplayArray(state->bulletOrder, state->game.sortedBullets * sizeof(t_bulletKey));
+    writeReplayArray(state->shotBullets, state->game.shotBullets * sizeof(t_u32));
+
+    // replay of a crashed run keeps everything up to its last keyframe
+    fflush(g_replay.pFile);
+}
+
+void writeReplayArray(const void *data, size_t size)
+{
+    const t_u8 padding[8] = { 0 };
+
+    fwrite(data, 1, size, g_replay.pFile);
+    fwrite(padding, 1, alignReplay(size) - size, g_replay.pFile);
+}
+
+inline size_t alignReplay(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+bool initReplay(const char *path)
+{
+#ifdef __linux__
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &info) == -1 || info.st_size == 0)
+    {
+        printf("Unable to open replay file %s\n", path);
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    // pages of file are read in only when seeking touches them,
+    // mapping stays valid after file is closed
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        printf("Unable to map replay file %s\n", path);
+        return false;
+    }
+
+    g_replay.pData = (const t_u8 *)data;
+    g_replay.size = info.st_size;
+
+    const t_replayHeader *header = (const t_replayHeader *)g_replay.pData;
+
+    if (g_replay.size < sizeof(t_replayHeader) ||
+        memcmp(header->magic, "SIREPLAY", sizeof(header->magic)) != 0 ||
+        header->version != REPLAY_VERSION ||
+        header->keyframeSize != sizeof(t_keyframe) ||
+        header->elementsSize != sizeof(t_alienData) + sizeof(t_timer) + sizeof(t_bulletData) + sizeof(t_bulletKey) ||
+        header->keyframeTicks == 0 ||
+        header->formationRows < 1 || header->formationRows > FORMATION_MAX_ROWS ||
+        header->formationCols < 1 || header->formationCols > FORMATION_MAX_COLS ||
+        header->maxBullets < 1 || header->maxBullets > BULLETS_LIMIT)
+    {
+        printf("File %s is not a replay recorded by this build\n", path);
+        closeReplay();
+        return false;
+    }
+
+    // world is sized as it was when replay was recorded
+    g_options.formationRows = header->formationRows;
+    g_options.formationCols = header->formationCols;
+    g_options.maxBullets = header->maxBullets;
+    g_replay.keyframeTicks = header->keyframeTicks;
+
+    // every keyframe starts after inputs of previous one, so walking
+    // through their headers indexes the whole file
+    g_replay.keyframes = (t_u64 *)malloc((g_replay.size / sizeof(t_keyframe) + 1) * sizeof(t_u64));
+    if (g_replay.keyframes == NULL)
+    {
+        printf("Unable to allocate replay index\n");
+        closeReplay();
+        return false;
+    }
+
+    size_t offset = alignReplay(sizeof(t_replayHeader));
+    g_replay.keyframesCount = 0;
+
+    while (offset + sizeof(t_keyframe) <= g_replay.size)
+    {
+        const t_keyframe *keyframe = (const t_keyframe *)(g_replay.pData + offset);
+
+        // keyframe cut off by crashed recording is dropped with the rest of file
+        if (keyframe->game.lastBullet > g_options.maxBullets ||
+            keyframe->game.sortedBullets > keyframe->game.lastBullet ||
+            keyframe->game.shotBullets > g_options.maxBullets ||
+            keyframe->size != getKeyframeSize(&keyframe->game) ||
+            offset + keyframe->size > g_replay.size)
+        {
+            break;
+        }
+
+        if (g_replay.keyframesCount == 0)
+            g_replay.firstTick = keyframe->game.ticks;
+
+        g_replay.keyframes[g_replay.keyframesCount++] = offset;
+        g_replay.endTick = keyframe->game.ticks +
+            SDL_min(g_replay.keyframeTicks, g_replay.size - offset - keyframe->size);
+
+        offset = alignReplay(offset + keyframe->size + g_replay.keyframeTicks);
+    }
+
+    if (g_replay.keyframesCount == 0)
+    {
+        printf("Replay %s has no complete keyframe\n", path);
+        closeReplay();
+        return false;
+    }
+
+    printf("Replay of ticks %u-%u with %u keyframes\n",
+        g_replay.firstTick, g_replay.endTick, g_replay.keyframesCount);
+
+    g_replay.isPlaying = true;
+    g_replay.isPaused = false;
+    g_replay.hasSeek = false;
+
+    return true;
+#else
+    printf("Replays are supported on Linux only\n");
+    return false;
+#endif
+}
+
+void closeReplay()
+{
+    if (g_replay.pFile != NULL)
+        fclose(g_replay.pFile);
+    g_replay.pFile = NULL;
+    closeWorldState(&g_replay.state);
+
+#ifdef __linux__
+    if (g_replay.pData != NULL)
+        munmap((void *)g_replay.pData, g_replay.size);
+#endif
+    g_replay.pData = NULL;
+
+    free(g_replay.keyframes);
+    g_replay.keyframes = NULL;
+
+    g_replay.isRecording = false;
+    g_replay.isPlaying = false;
+}
+
+void viewKeyframe(const t_keyframe *keyframe, t_worldState *view)
+{
+    t_u32 aliensCount = g_options.formationRows * g_options.formationCols;
+    const t_u8 *arrays = (const t_u8 *)(keyframe + 1);
+
+    // arrays are used right from the mapped file
+    view->game = keyframe->game;
+    view->playerData = keyframe->playerData;
+    view->aliensData = keyframe->aliensData;
+    view->ufoData = keyframe->ufoData;
+    memcpy(view->shields, keyframe->shields, sizeof(view->shields));
+    view->timers = keyframe->timers;
+    view->aliens = (t_alienData *)arrays;
+    arrays += alignReplay(aliensCount * sizeof(t_alienData));
+    view->timerPool = (t_timer *)arrays;
+    arrays += alignReplay((aliensCount + EXTRA_TIMERS) * sizeof(t_timer));
+    view->bullets = (t_bulletData *)arrays;
+    arrays += alignReplay(keyframe->game.lastBullet * sizeof(t_bulletData));
+    view->bulletOrder = (t_bulletKey *)arrays;
+    arrays += alignReplay(keyframe->game.sortedBullets * sizeof(t_bulletKey));
+    view->shotBullets = (t_u32 *)arrays;
+}
+
+// compares state that decides how the game goes on, field by field,
+// as structures have padding and free bullets keep stale positions
+bool matchesWorld(const t_worldState *state)
+{
+    t_u32 i, aliensCount = g_options.formationRows * g_options.formationCols;
+
+    if (g_game.ticks != state->game.ticks ||
+        g_game.rngState != state->game.rngState ||
+        g_game.score != state->game.score ||
+        g_game.wave != state->game.wave ||
+        g_game.lastBullet != state->game.lastBullet ||
+        g_game.visibleBullets != state->game.visibleBullets)
+    {
+        return false;
+    }
+
+    if (g_playerData.position.x != state->playerData.position.x ||
+        g_playerData.position.y != state->playerData.position.y ||
+        g_playerData.lifes != state->playerData.lifes ||
+        g_playerData.deathTime != state->playerData.deathTime ||
+        g_playerData.isInvincible != state->playerData.isInvincible)
+    {
+        return false;
+    }
+
+    if (g_aliensData.position.x != state->aliensData.position.x ||
+        g_aliensData.position.y != state->aliensData.position.y ||
+        g_aliensData.moving != state->aliensData.moving ||
+        g_aliensData.aliveCount != state->aliensData.aliveCount)
+    {
+        return false;
+    }
+
+    if (g_ufoData.isActive != state->ufoData.isActive ||
+        g_ufoData.x != state->ufoData.x ||
+        g_ufoData.deathTime != state->ufoData.deathTime ||
+        g_ufoData.nextTime != state->ufoData.nextTime)
+    {
+        return false;
+    }
+
+    for (i = 0; i < SHIELDS_COUNT; i++)
+        if (memcmp(g_shields[i].rows, state->shields[i].rows, sizeof(g_shields[i].rows)) != 0)
+            return false;
+
+    for (i = 0; i < aliensCount; i++)
+        if (g_aliens[i].isHidden != state->aliens[i].isHidden ||
+            g_aliens[i].deathTime != state->aliens[i].deathTime)
+        {
+            return false;
+        }
+
+    for (i = 0; i < g_game.lastBullet; i++)
+    {
+        const t_bulletData *bullet = &g_bullets[i], *other = &state->bullets[i];
+
+        if (bullet->isVisible != other->isVisible ||
+            (bullet->isVisible && (bullet->entity != other->entity ||
+                bullet->position.x != other->position.x ||
+                bullet->position.y != other->position.y)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void seekReplay(t_u32 tick)
+{
+    tick = SDL_max(SDL_min(tick, g_replay.endTick), g_replay.firstTick);
+
+    t_u32 index = SDL_min((tick - g_replay.firstTick) / g_replay.keyframeTicks, g_replay.keyframesCount - 1);
+    const t_keyframe *keyframe = (const t_keyframe *)(g_replay.pData + g_replay.keyframes[index]);
+
+    // ufo siren of the world being left must not keep playing
+    if (g_ufoData.isActive)
+        scheduleSound(TIMELINE_UFO_STOP);
+
+    // world is restored from keyframe, unless it's enough to step forward from current tick
+    if (!g_replay.hasWorld || tick < g_game.ticks || keyframe->game.ticks > g_game.ticks)
+    {
+        t_worldState view;
+
+        viewKeyframe(keyframe, &view);
+
+        // game keeps running, whatever keyframe says
+        bool isRunning = g_game.isRunning;
+        loadWorld(&view);
+        g_game.isRunning = isRunning;
+        g_replay.hasWorld = true;
+    }
+
+    // ticks up to the wanted one are simulated silently
+    bool isMuted = g_isMuted;
+    g_isMuted = true;
+    while (g_game.ticks < tick)
+        stepReplay();
+    g_isMuted = isMuted;
+
+    if (g_ufoData.isActive && g_ufoData.deathTime == 0)
+        scheduleSound(TIMELINE_UFO_START);
+}
+
+void stepReplay()
+{
+    t_u32 tick = g_game.ticks - g_replay.firstTick;
+    const t_u8 *keyframe = g_replay.pData + g_replay.keyframes[tick / g_replay.keyframeTicks];
+
+    // inputs of ticks follow their keyframe
+    t_u8 input = keyframe[((const t_keyframe *)keyframe)->size + tick % g_replay.keyframeTicks];
+
+    g_playerData.movement = (e_movingDirections)(input & ~REPLAY_INPUT_SHOOTING);
+    g_playerData.isShooting = (input & REPLAY_INPUT_SHOOTING) != 0;
+
+    update();
+}
+
+void updateReplay()
+{
+    if (g_replay.hasSeek)
+    {
+        g_replay.hasSeek = false;
+        seekReplay(g_replay.seekTick);
+    }
+    else if (!g_replay.isPaused)
+    {
+        // stop at the end, so that last frame can be looked at
+        if (g_game.ticks < g_replay.endTick)
+            stepReplay();
+        else g_replay.isPaused = true;
+    }
+}
+
+bool runHeadless()
+{
+    t_u32 firstTick = g_game.ticks;
+    t_u64 start = SDL_GetPerformanceCounter();
+
+    // same frames as a watched replay, as fast as they can be made
+    while (g_game.ticks < g_replay.endTick)
+    {
+        t_u32 tick = g_game.ticks - g_replay.firstTick;
+
+        // world stepped up to a keyframe must be the recorded one,
+        // otherwise simulation changed since and replay measures nothing
+        if (tick % g_replay.keyframeTicks == 0)
+        {
+            const t_keyframe *keyframe = (const t_keyframe *)
+                (g_replay.pData + g_replay.keyframes[tick / g_replay.keyframeTicks]);
+            t_worldState view;
+
+            viewKeyframe(keyframe, &view);
+            if (!matchesWorld(&view))
+            {
+                printf("Replay diverged from its keyframe at tick %u\n", g_game.ticks);
+                return false;
+            }
+        }
+
+        stepReplay();
+        render();
+
+        if (g_telemetry.pData != NULL)
+            publishTelemetry();
+    }
+
+    double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+    t_u32 ticks = g_game.ticks - firstTick;
+
+    printf("Replayed %u ticks in %.3f ms, %.0f ticks/s\n", ticks, ms, ticks * 1000 / SDL_max(ms, 1e-6));
+
+    return true;
+}
+
+bool handleReplayEvent(const SDL_Event *e)
+{
+    t_i64 tick = g_replay.hasSeek ? g_replay.seekTick : g_game.ticks;
+
+    if (e->type == SDL_KEYDOWN)
+    {
+        switch (e->key.keysym.sym)
+        {
+            case SDLK_SPACE:
+                if (e->key.repeat == 0)
+                    g_replay.isPaused = !g_replay.isPaused;
+                return true;
+            // single ticks are stepped while holding arrows
+            case SDLK_LEFT:     tick--; break;
+            case SDLK_RIGHT:    tick++; break;
+            case SDLK_PAGEUP:   tick -= g_replay.keyframeTicks; break;
+            case SDLK_PAGEDOWN: tick += g_replay.keyframeTicks; break;
+            case SDLK_HOME:     tick = g_replay.firstTick; break;
+            case SDLK_END:      tick = g_replay.endTick; break;
+            default:
+                return false;
+        }
+
+        g_replay.seekTick = SDL_max(SDL_min(tick, g_replay.endTick), g_replay.firstTick);
+        g_replay.hasSeek = true;
+        g_replay.isPaused = true;
+
+        return true;
+    }
+
+    // whole window works as timeline while mouse button is held
+    if (e->type == SDL_MOUSEBUTTONDOWN && e->button.button == SDL_BUTTON_LEFT)
+    {
+        g_replay.isScrubbing = true;
+        scrubReplay(e->button.x);
+        return true;
+    }
+    if (e->type == SDL_MOUSEMOTION && g_replay.isScrubbing)
+    {
+        scrubReplay(e->motion.x);
+        return true;
+    }
+    if (e->type == SDL_MOUSEBUTTONUP && e->button.button == SDL_BUTTON_LEFT)
+    {
+        g_replay.isScrubbing = false;
+        return true;
+    }
+
+    return false;
+}
+
+void scrubReplay(int windowX)
+{
+    SDL_Rect presentRect;
+    int windowW, windowH, outputW, outputH;
+
+    // mouse is in window coordinates, presented target in output pixels
+    SDL_GetWindowSize(g_SDLData.pWindow, &windowW, &windowH);
+    SDL_GetRendererOutputSize(g_SDLData.pRenderer, &outputW, &outputH);
+    getPresentRect(&presentRect);
+
+    float position = ((float)windowX * outputW / SDL_max(windowW, 1) - presentRect.x) / SDL_max(presentRect.w, 1);
+    position = SDL_max(SDL_min(position, 1.0f), 0.0f);
+
+    // seek is done once per frame, however many motion events there were
+    g_replay.seekTick = g_replay.firstTick + (t_u32)(position * (g_replay.endTick - g_replay.firstTick) + 0.5f);
+    g_replay.hasSeek = true;
+    g_replay.isPaused = true;
+}
+
+void renderReplayBar()
+{
+    SDL_Rect bar;
+    t_u32 length = SDL_max(g_replay.endTick - g_replay.firstTick, 1);
+
+    bar.x = 0;
+    bar.y = SCREEN_H - REPLAY_BAR_H;
+    bar.w = SCREEN_W;
+    bar.h = REPLAY_BAR_H;
+
+    SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0x40, 0x40, 0x40, 0xFF);
+    SDL_RenderFillRect(g_SDLData.pRenderer, &bar);
+
+    bar.w = (t_u64)(g_game.ticks - g_replay.firstTick) * SCREEN_W / length;
+
+    SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+    SDL_RenderFillRect(g_SDLData.pRenderer, &bar);
+}
+
+bool initSpectator()
+{
+    t_u16 i;
+    int textureW, textureH;
+
+    g_spectator.worldsCount = g_options.spectateCount;
+    g_spectator.worlds = (t_spectatorWorld *)calloc(g_spectator.worldsCount, sizeof(t_spectatorWorld));
+    g_spectator.tileRects = (SDL_Rect *)calloc(g_spectator.worldsCount, sizeof(SDL_Rect));
+    g_spectator.clearRects = (SDL_Rect *)calloc(g_spectator.worldsCount, sizeof(SDL_Rect));
+
+    if (g_spectator.worlds == NULL || g_spectator.tileRects == NULL || g_spectator.clearRects == NULL)
+    {
+        printf("Unable to allocate %u spectated worlds\n", g_spectator.worldsCount);
+        closeSpectator();
+        return false;
+    }
+
+    for (i = 0; i < g_spectator.worldsCount; i++)
+    {
+        t_spectatorWorld *world = &g_spectator.worlds[i];
+
+        if (!initWorldState(&world->state))
+        {
+            closeSpectator();
+            return false;
+        }
+
+        t_u32 rngState = g_game.rngState + i;
+        world->seed = nextRandom(&rngState) | 1;
+    }
+
+    // grid about as square as the worlds are
+    g_spectator.cols = 1;
+    while (g_spectator.cols * g_spectator.cols < g_spectator.worldsCount)
+        g_spectator.cols++;
+    g_spectator.rows = (g_spectator.worldsCount + g_spectator.cols - 1) / g_spectator.cols;
+
+    // one pixel of every tile is left as a gap between worlds
+    g_spectator.scale = SDL_min(
+        (float)(SCREEN_W / g_spectator.cols - 1) / g_world.w,
+        (float)(SCREEN_H / g_spectator.rows - 1) / g_world.h);
+
+    if (g_spectator.scale <= 0)
+    {
+        printf("%u worlds don't fit the screen\n", g_spectator.worldsCount);
+        closeSpectator();
+        return false;
+    }
+
+    for (i = 0; i < g_spectator.worldsCount; i++)
+    {
+        t_u16 col = i % g_spectator.cols, row = i / g_spectator.cols;
+        SDL_Rect *tile = &g_spectator.tileRects[i];
+
+        tile->x = col * SCREEN_W / g_spectator.cols;
+        tile->y = row * SCREEN_H / g_spectator.rows;
+        tile->w = (col + 1) * SCREEN_W / g_spectator.cols - tile->x;
+        tile->h = (row + 1) * SCREEN_H / g_spectator.rows - tile->y;
+    }
+
+    // any opaque pixel of bullet works, it is tinted by vertex color
+    t_u8 x = 0, y = 0;
+    while (y < g_bulletMask.h && !(g_bulletMask.rows[y] & ((t_u64)1 << x)))
+    {
+        x = (x + 1) % g_bulletMask.w;
+        y += x == 0;
+    }
+
+    if (g_spritesData.pTexture != NULL)
+    {
+        SDL_QueryTexture(g_spritesData.pTexture, NULL, NULL, &textureW, &textureH);
+        g_spectator.textureW = textureW;
+        g_spectator.textureH = textureH;
+        g_spectator.solidTexel.x = (g_clips.bullet.x + x + 0.5f) / textureW;
+        g_spectator.solidTexel.y = (g_clips.bullet.y + y + 0.5f) / textureH;
+    }
+
+    g_spectator.isRedrawAll = true;
+    g_spectator.frames = 0;
+    g_spectator.reportTime = SDL_GetPerformanceCounter();
+    g_spectator.reportFrames = 0;
+    g_spectator.reportTiles = 0;
+
+    // worlds are stepped by autopilot workers
+    if (!initAutopilotWorkers())
+    {
+        closeSpectator();
+        return false;
+    }
+
+    g_spectator.isEnabled = true;
+
+    printf("Spectating %u worlds in %ux%u tiles\n",
+        g_spectator.worldsCount, g_spectator.cols, g_spectator.rows);
+
+    return true;
+}
+
+void closeSpectator()
+{
+    t_u16 i;
+
+    if (g_spectator.worlds != NULL)
+        for (i = 0; i < g_spectator.worldsCount; i++)
+            closeWorldState(&g_spectator.worlds[i].state);
+
+    free(g_spectator.worlds);
+    free(g_spectator.tileRects);
+    free(g_spectator.clearRects);
+    free(g_spectator.vertices);
+    free(g_spectator.indices);
+    g_spectator.worlds = NULL;
+    g_spectator.tileRects = NULL;
+    g_spectator.clearRects = NULL;
+    g_spectator.vertices = NULL;
+    g_spectator.indices = NULL;
+    g_spectator.quadsCapacity = 0;
+    g_spectator.isEnabled = false;
+}
+
+void stepSpectatorWorlds(t_u8 worker)
+{
+    t_u32 i;
+
+    // worlds are dealt to workers in turn, each one is
+    // stepped in worker's own world and copied back
+    for (i = worker; i < g_spectator.worldsCount; i += g_autopilot.workersCount)
+    {
+        t_spectatorWorld *world = &g_spectator.worlds[i];
+
+        if (world->isStarted)
+        {
+            loadWorld(&world->state);
+        }
+        else
+        {
+            g_game.ticks = 0;
+            g_game.rngState = world->seed;
+            startGame();
+            world->isStarted = true;
+        }
+
+        // random player holds its action as long as rollouts do
+        if (g_game.ticks % AUTOPILOT_DECISION_TICKS == 0)
+            world->action = nextRandom(&world->seed) % AUTOPILOT_ACTION_COUNT;
+
+        applyAutopilotAction(world->action);
+        update();
+
+        if (g_playerData.lifes != world->lifes || g_game.wave != world->wave)
+            world->interestTick = g_game.ticks;
+        world->lifes = g_playerData.lifes;
+        world->wave = g_game.wave;
+
+        saveWorld(&world->state);
+    }
+}
+
+void updateSpectator()
+{
+    t_u8 i;
+
+    for (i = 0; i < g_autopilot.workersCount; i++)
+        SDL_SemPost(g_autopilot.workers[i].pStart);
+    for (i = 0; i < g_autopilot.workersCount; i++)
+        SDL_SemWait(g_autopilot.pDone);
+}
+
+void renderSpectator()
+{
+    t_u16 i;
+    t_u32 tilesCount = 0;
+
+    SDL_SetRenderTarget(g_SDLData.pRenderer, g_SDLData.pTarget);
+    SDL_RenderSetScale(g_SDLData.pRenderer, 1, 1);
+    g_spectator.quadsCount = 0;
+
+    for (i = 0; i < g_spectator.worldsCount; i++)
+    {
+        const t_spectatorWorld *world = &g_spectator.worlds[i];
+        const t_worldState *state = &world->state;
+
+        // player being hit, ufo and new waves are worth every frame,
+        // the rest of worlds take turns
+        bool isInteresting = state->playerData.deathTime > 0 || state->ufoData.isActive ||
+            state->game.ticks - world->interestTick < SPECTATOR_INTEREST_TICKS;
+
+        if (!world->isStarted ||
+            (!g_spectator.isRedrawAll && !isInteresting && (g_spectator.frames + i) % SPECTATOR_IDLE_FRAMES != 0))
+        {
+            continue;
+        }
+
+        // tiles to draw are collected, so that they are cleared at once
+        const SDL_Rect *tile = &g_spectator.tileRects[i];
+        g_spectator.clearRects[tilesCount++] = *tile;
+
+        g_spectator.originX = tile->x + (tile->w - 1 - g_world.w * g_spectator.scale) / 2;
+        g_spectator.originY = tile->y + (tile->h - 1 - g_world.h * g_spectator.scale) / 2;
+        g_spectator.tile = *tile;
+
+        if (!reserveSpectatorQuads(g_options.formationRows * g_options.formationCols +
+            state->game.lastBullet + SHIELDS_COUNT + 2))
+        {
+            break;
+        }
+
+        addSpectatorWorld(state);
+    }
+
+    if (g_SDLData.pRenderer == NULL)
+    {
+        g_SDLData.nullRenderCount += g_spectator.quadsCount;
+    }
+    else
+    {
+        SDL_SetRenderDrawColor(g_SDLData.pRenderer, 0x00, 0x00, 0x00, 0xFF);
+        SDL_RenderFillRects(g_SDLData.pRenderer, g_spectator.clearRects, tilesCount);
+        SDL_RenderGeometry(g_SDLData.pRenderer, g_spritesData.pTexture,
+            g_spectator.vertices, g_spectator.quadsCount * 4,
+            g_spectator.indices, g_spectator.quadsCount * 6);
+    }
+
+    g_spectator.isRedrawAll = false;
+    g_spectator.frames++;
+
+    // report performance once per second
+    g_spectator.reportFrames++;
+    g_spectator.reportTiles += tilesCount;
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now - g_spectator.reportTime >= SDL_GetPerformanceFrequency())
+    {
+        printf("Spectator: %.0f FPS, %u of %u worlds drawn per frame\n",
+            (double)g_spectator.reportFrames * SDL_GetPerformanceFrequency() / (now - g_spectator.reportTime),
+            g_spectator.reportTiles / g_spectator.reportFrames, g_spectator.worldsCount);
+
+        g_spectator.reportTime = now;
+        g_spectator.reportFrames = 0;
+        g_spectator.reportTiles = 0;
+    }
+
+    presentTarget();
+}
+
+void addSpectatorWorld(const t_worldState *state)
+{
+    t_u32 i, ticks = state->game.ticks;
+    t_u16 row, col;
+
+    // player blinks and explodes as in render()
+    if (!state->playerData.isInvincible || (ticks - state->playerData.lastHit) / 12 % 2 == 0)
+    {
+        addSpectatorQuad(state->playerData.deathTime > 0
+                ? &g_clips.explosions[(ticks - state->playerData.deathTime) / 8 % 4]
+                : &g_clips.player,
+            state->playerData.position.x, state->playerData.position.y,
+            PLAYER_W, PLAYER_H);
+    }
+
+    for (row = 0; row < g_options.formationRows; row++)
+        for (col = 0; col < g_options.formationCols; col++)
+        {
+            const t_alienData *alien = &state->aliens[row * g_options.formationCols + col];
+
+            if (!alien->isHidden)
+                addSpectatorQuad(getAlienClip(alien, ticks),
+                    formationX(&state->aliensData, col), formationY(&state->aliensData, row),
+                    ALIEN_W, ALIEN_H);
+        }
+
+    for (i = 0; i < state->game.lastBullet; i++)
+        if (state->bullets[i].isVisible)
+            addSpectatorQuad(&g_clips.bullet,
+                state->bullets[i].position.x, state->bullets[i].position.y, BULLET_W, BULLET_H);
+
+    if (state->ufoData.isActive)
+    {
+        addSpectatorQuad(state->ufoData.deathTime > 0
+                ? &g_clips.explosions[(ticks - state->ufoData.deathTime) / (ALIEN_EXPLOSION_TIME / 4) % 4]
+                : &g_clips.ufo,
+            state->ufoData.x, UFO_Y, UFO_W, UFO_H);
+    }
+
+    // shields are too small in a tile to show craters,
+    // only rows still standing are drawn
+    for (i = 0; i < SHIELDS_COUNT; i++)
+    {
+        const t_u64 *rows = state->shields[i].rows;
+        t_i16 top = 0, bottom = SHIELD_H;
+
+        while (top < bottom && rows[top] == 0)
+            top++;
+        while (bottom > top && rows[bottom - 1] == 0)
+            bottom--;
+
+        if (top < bottom)
+            addSpectatorQuad(NULL, shieldX(i), SHIELD_Y + top, SHIELD_W, bottom - top);
+    }
+}
+
+bool reserveSpectatorQuads(t_u32 count)
+{
+    t_u32 i, capacity = g_spectator.quadsCapacity;
+
+    if (g_spectator.quadsCount + count <= capacity)
+        return true;
+
+    // buffers only grow, so after first frames nothing is allocated
+    while (capacity < g_spectator.quadsCount + count)
+        capacity = SDL_max(capacity * 2, 1024);
+
+    SDL_Vertex *vertices = (SDL_Vertex *)realloc(g_spectator.vertices, capacity * 4 * sizeof(SDL_Vertex));
+    if (vertices != NULL)
+        g_spectator.vertices = vertices;
+
+    int *indices = (int *)realloc(g_spectator.indices, capacity * 6 * sizeof(int));
+    if (indices != NULL)
+        g_spectator.indices = indices;
+
+    if (vertices == NULL || indices == NULL)
+    {
+        printf("Unable to allocate %u spectator quads\n", capacity);
+        return false;
+    }
+
+    // indices of quads are the same every frame
+    for (i = g_spectator.quadsCapacity; i < capacity; i++)
+    {
+        g_spectator.indices[i * 6 + 0] = i * 4 + 0;
+        g_spectator.indices[i * 6 + 1] = i * 4 + 1;
+        g_spectator.indices[i * 6 + 2] = i * 4 + 2;
+        g_spectator.indices[i * 6 + 3] = i * 4 + 2;
+        g_spectator.indices[i * 6 + 4] = i * 4 + 3;
+        g_spectator.indices[i * 6 + 5] = i * 4 + 0;
+    }
+
+    g_spectator.quadsCapacity = capacity;
+
+    return true;
+}
+
+void addSpectatorQuad(const SDL_Rect *clip, float x, float y, float w, float h)
+{
+    const SDL_Rect *tile = &g_spectator.tile;
+    float left = g_spectator.originX + x * g_spectator.scale;
+    float top = g_spectator.originY + y * g_spectator.scale;
+    float right = left + w * g_spectator.scale;
+    float bottom = top + h * g_spectator.scale;
+    // ufo and bullets fly past world's edges, so quad is clipped to tile
+    // not to draw over neighbouring ones, which aren't redrawn every frame
+    float clippedLeft = SDL_max(left, (float)tile->x);
+    float clippedTop = SDL_max(top, (float)tile->y);
+    float clippedRight = SDL_min(right, (float)(tile->x + tile->w));
+    float clippedBottom = SDL_min(bottom, (float)(tile->y + tile->h));
+    t_u8 corner;
+
+    if (clippedLeft >= clippedRight || clippedTop >= clippedBottom)
+        return;
+
+    SDL_Vertex *quad = &g_spectator.vertices[g_spectator.quadsCount++ * 4];
+
+    for (corner = 0; corner < 4; corner++)
+    {
+        // corners go clockwise starting from top-left
+        bool isRight = corner == 1 || corner == 2;
+        bool isBottom = corner >= 2;
+
+        quad[corner].position.x = isRight ? clippedRight : clippedLeft;
+        quad[corner].position.y = isBottom ? clippedBottom : clippedTop;
+
+        // quad without clip is filled with solid texel,
+        // clipped part of sprite is cut off as much as of quad
+        if (clip != NULL)
+        {
+            quad[corner].tex_coord.x =
+                (clip->x + (quad[corner].position.x - left) / (right - left) * clip->w) / g_spectator.textureW;
+            quad[corner].tex_coord.y =
+                (clip->y + (quad[corner].position.y - top) / (bottom - top) * clip->h) / g_spectator.textureH;
+        }
+        else quad[corner].tex_coord = g_spectator.solidTexel;
+
+        quad[corner].color.r = 0xFF;
+        quad[corner].color.g = 0xFF;
+        quad[corner].color.b = 0xFF;
+        quad[corner].color.a = 0xFF;
+    }
+}
+
+bool initTelemetry(const char *name)
+{
+#ifdef __linux__
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+    if (fd == -1 || ftruncate(fd, sizeof(t_telemetryData)) == -1)
+    {
+        printf("Unable to create telemetry segment %s\n", name);
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, sizeof(t_telemetryData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        printf("Unable to map telemetry segment %s\n", name);
+        shm_unlink(name);
+        return false;
+    }
+
+    // everything is set up here, publishing is just stores into mapped pages
+    g_telemetry.pData = (t_telemetryData *)data;
+    g_telemetry.name = name;
+    memset(g_telemetry.pData, 0, sizeof(t_telemetryData));
+    g_telemetry.pData->version = TELEMETRY_VERSION;
+
+    g_telemetry.frameTime = SDL_GetPerformanceCounter();
+    g_telemetry.rateTime = g_telemetry.frameTime;
+    g_telemetry.rateTicks = g_game.ticks;
+    g_telemetry.ticksPerSecond = 0;
+
+    return true;
+#else
+    printf("Telemetry is supported on Linux only\n");
+    return false;
+#endif
+}
+
+void closeTelemetry()
+{
+#ifdef __linux__
+    if (g_telemetry.pData == NULL)
+        return;
+
+    // readers keep their mapping, segment is gone once they close it
+    munmap(g_telemetry.pData, sizeof(t_telemetryData));
+    shm_unlink(g_telemetry.name);
+    g_telemetry.pData = NULL;
+#endif
+}
+
+void publishTelemetry()
+{
+    t_telemetryData *data = g_telemetry.pData;
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    if (now - g_telemetry.rateTime >= frequency)
+    {
+        g_telemetry.ticksPerSecond = (double)(g_game.ticks - g_telemetry.rateTicks) * frequency /
+            (now - g_telemetry.rateTime);
+        g_telemetry.rateTime = now;
+        g_telemetry.rateTicks = g_game.ticks;
+    }
+
+    // release fence and store keep counters' stores strictly between
+    // sequence stores, as reader sees them in the order they are made.
+    // game is the only writer, so sequence is read plainly
+    int sequence = data->sequence;
+    __atomic_store_n(&data->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    data->frames++;
+    data->frameTimeUs = (now - g_telemetry.frameTime) * 1000000 / frequency;
+    data->ticksPerSecond = g_telemetry.ticksPerSecond;
+    data->ticks = g_game.ticks;
+    data->bullets = g_game.visibleBullets;
+    data->aliens = g_aliensData.aliveCount;
+    data->audioUnderruns = SDL_AtomicGet(&g_audioTimeline.underruns);
+
+    __atomic_store_n(&data->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    g_telemetry.frameTime = now;
+}
+
+// benchmarks include this file and provide their own main()
+#ifndef SPACE_INVADERS_NO_MAIN
+int main(int argc, char *argv[])
+{
+    // headless replay fails the run, when it diverged from its keyframes
+    bool isReplayMatched = true;
+
+    g_SDLData.pWindow = NULL;
+    g_SDLData.pRenderer = NULL;
+    g_SDLData.pTarget = NULL;
+    g_spritesData.pTexture = NULL;
+    g_game.isRunning = false;
+
+    if (!parseArgs(argc, argv))
+        exit(1);
+
+    if (initSDL())
+    {
+        // game isn't running, when anything it needs failed to init
+        if (initGame())
+        {
+            startGame();
+
+            if (g_replay.isPlaying)
+                seekReplay(g_options.seekTick);
+
+            if (g_options.headless)
+            {
+                isReplayMatched = runHeadless();
+                g_game.isRunning = false;
+            }
+        }
+
+        while (g_game.isRunning)
+        {
+            handleEvents();
+
+            // spectated worlds replace the game
+            if (g_spectator.isEnabled)
+            {
+                updateSpectator();
+                renderSpectator();
+                continue;
+            }
+
+            // replay brings its own inputs
+            if (g_replay.isPlaying)
+            {
+                updateReplay();
+            }
+            else
+            {
+                if (g_autopilot.isEnabled)
+                    updateAutopilot();
+                else handleKeyStates();
+
+                if (g_replay.isRecording)
+                    recordTick();
+
+                update();
+            }
+
+            render();
+
+            if (g_telemetry.pData != NULL)
+                publishTelemetry();
+        }       
+    }
+    else
+    {
+        printf("SDL init error\n");
+        exit(1);
+    }
+
+    close();
+
+    return isReplayMatched ? 0 : 1;
 }
+#endif
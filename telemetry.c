@@ -0,0 +1,110 @@
+// Prints counters a running game publishes with --telemetry NAME.
+//
+// Build next to telemetry.h, neither SDL nor the game is needed:
+//   g++ -O2 telemetry.c -o telemetry -lrt
+// Run while the game is running:
+//   ./telemetry NAME [--interval MS]
+//
+// Reading never blocks the game, the game never waits for readers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "telemetry.h"
+
+#define TELEMETRY_DEFAULT_INTERVAL 1000
+
+int main(int argc, char *argv[])
+{
+    const char *name = NULL;
+    unsigned int interval = TELEMETRY_DEFAULT_INTERVAL;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+        {
+            int value = atoi(argv[++i]);
+            interval = value > 1 ? value : 1;
+        }
+        else if (name == NULL && argv[i][0] != '-')
+            name = argv[i];
+        else
+        {
+            printf("Usage: %s NAME [--interval MS]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (name == NULL)
+    {
+        printf("Usage: %s NAME [--interval MS]\n", argv[0]);
+        return 1;
+    }
+
+#ifdef __linux__
+    // reader only loads counters, so game's segment is mapped read-only
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1)
+    {
+        printf("Telemetry segment %s doesn't exist, is the game running with --telemetry %s?\n", name, name);
+        return 1;
+    }
+
+    void *data = mmap(NULL, sizeof(t_telemetryData), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        printf("Unable to map telemetry segment %s\n", name);
+        return 1;
+    }
+
+    const t_telemetryData *shared = (const t_telemetryData *)data;
+    t_telemetryData counters;
+    unsigned long long lastFrames = 0;
+
+    if (shared->version != TELEMETRY_VERSION)
+    {
+        printf("Telemetry segment %s has version %u, expected %u\n", name, shared->version, TELEMETRY_VERSION);
+        return 1;
+    }
+
+    printf("%10s %10s %8s %10s %8s %8s %10s\n",
+        "frame", "frame ms", "ticks/s", "tick", "bullets", "aliens", "underruns");
+
+    while (true)
+    {
+        if (!readTelemetry(shared, &counters))
+            printf("Counters changed on every read attempt\n");
+        // game that exited or hangs doesn't publish new frames
+        else if (counters.frames == lastFrames)
+            printf("No new frames\n");
+        else
+        {
+            printf("%10llu %10.2f %8u %10u %8u %8u %10u\n",
+                (unsigned long long)counters.frames, counters.frameTimeUs / 1000.0,
+                counters.ticksPerSecond, counters.ticks,
+                counters.bullets, counters.aliens, counters.audioUnderruns);
+            // failed read leaves torn counters, they aren't remembered
+            lastFrames = counters.frames;
+        }
+
+        fflush(stdout);
+
+        struct timespec delay = { interval / 1000, (long)(interval % 1000) * 1000000 };
+        nanosleep(&delay, NULL);
+    }
+#else
+    printf("Telemetry is supported on Linux only\n");
+    return 1;
+#endif
+}
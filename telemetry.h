@@ -0,0 +1,52 @@
+// Counters a game running with --telemetry publishes through shared memory,
+// shared by the game writing them and tools reading them.
+// Only GCC atomics are used, so readers need neither SDL nor the game.
+
+#ifndef SPACE_INVADERS_TELEMETRY_H
+#define SPACE_INVADERS_TELEMETRY_H
+
+#include <stdbool.h>
+#include <string.h>
+
+#define TELEMETRY_VERSION        1
+// reader gives up, if writer keeps changing counters while they are copied
+#define TELEMETRY_READ_ATTEMPTS  100
+
+// counters are written once per frame under a sequence lock: writer keeps
+// sequence odd while it writes, reader copies counters and retries until
+// sequence was the same even number before and after the copy
+typedef struct
+{
+    unsigned int version;
+    int sequence;
+    unsigned long long frames;
+    unsigned int frameTimeUs;
+    unsigned int ticksPerSecond;
+    unsigned int ticks;
+    unsigned int bullets;
+    unsigned int aliens;
+    unsigned int audioUnderruns;
+} t_telemetryData;
+
+// only loads shared counters, so they can be mapped read-only
+static inline bool readTelemetry(const t_telemetryData *shared, t_telemetryData *copy)
+{
+    unsigned char attempt;
+
+    for (attempt = 0; attempt < TELEMETRY_READ_ATTEMPTS; attempt++)
+    {
+        // acquire load and fence pair with writer's release ones,
+        // so copy is read after the first sequence and before the second
+        int before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        memcpy(copy, shared, sizeof(t_telemetryData));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        int after = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED);
+
+        if (before % 2 == 0 && before == after)
+            return true;
+    }
+
+    return false;
+}
+
+#endif